@@ -0,0 +1,731 @@
+#pragma once
+
+// Lecture de l'audio à la demande: quel que soit le décodeur (FFmpeg, dr_wav, dr_mp3), une AudioSource
+// fournit des blocs mono WHISPER_SAMPLE_RATE float de la taille demandée, sans jamais garder le fichier
+// entier en mémoire.
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libswresample/swresample.h>
+}
+
+#include <android/log.h>
+#include "whisper.h"
+
+// Échantillons (à la fréquence d'origine) décodés par appel à dr_wav / dr_mp3
+#define AUDIO_SOURCE_READ_FRAMES 4096
+
+// Points d'accès de la table de seek MP3: un par AUDIO_SOURCE_MP3_SEEK_BYTES octets du fichier, soit au moins
+// un par seconde quel que soit le débit (8 kbit/s est le plus bas en MP3), jusqu'à AUDIO_SOURCE_MP3_SEEK_POINTS
+#define AUDIO_SOURCE_MP3_SEEK_POINTS 16384
+#define AUDIO_SOURCE_MP3_SEEK_BYTES  (8000/8)
+
+// Audio décodé puis jeté avant le début d'un extrait (voir RangeAudioSource): le décodeur (réservoir
+// de bits MP3, amorçage AAC) et les rééchantillonneurs se stabilisent après le seek
+#define AUDIO_SOURCE_PREROLL (WHISPER_SAMPLE_RATE/4)
+
+AVFormatContext* openSourceFile(const char* sourceFilePath) {
+    AVFormatContext* formatContext = nullptr;
+
+    // Ouvrir le fichier source
+    int result = avformat_open_input(&formatContext, sourceFilePath, nullptr, nullptr);
+    if (result < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to open source file: %s", av_err2str(result));
+        return nullptr;
+    }
+
+    // Récupérer les informations sur les flux dans le fichier source
+    result = avformat_find_stream_info(formatContext, nullptr);
+    if (result < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to retrieve source stream info: %s", av_err2str(result));
+        avformat_close_input(&formatContext);
+        return nullptr;
+    }
+
+    return formatContext;
+}
+
+int findAudioStreamIndex(AVFormatContext* formatContext) {
+    // Trouver l'index du flux audio
+    int audioStreamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (audioStreamIndex < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to find an audio stream in the source file");
+        return -1;
+    }
+
+    return audioStreamIndex;
+}
+
+AVCodecContext* initializeAudioDecoder(AVFormatContext* formatContext, int audioStreamIndex) {
+    // Récupérer le codec paramètres pour le flux audio
+    AVCodecParameters* codecParameters = formatContext->streams[audioStreamIndex]->codecpar;
+
+    // Trouver le décodeur pour le codec
+    auto* codec = const_cast<AVCodec *>(avcodec_find_decoder(codecParameters->codec_id));
+    if (!codec) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to find decoder for audio stream");
+        return nullptr;
+    }
+
+    // Allouer un contexte de codec et l'initialiser avec les paramètres du codec
+    AVCodecContext* codecContext = avcodec_alloc_context3(codec);
+    if (!codecContext) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to allocate codec context");
+        return nullptr;
+    }
+
+    // Initialiser le contexte du codec avec les paramètres du codec
+    int result = avcodec_parameters_to_context(codecContext, codecParameters);
+    if (result < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to initialize codec context: %s", av_err2str(result));
+        avcodec_free_context(&codecContext);
+        return nullptr;
+    }
+
+    // Ouvrir le codec
+    result = avcodec_open2(codecContext, codec, nullptr);
+    if (result < 0) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to open codec: %s", av_err2str(result));
+        avcodec_free_context(&codecContext);
+        return nullptr;
+    }
+
+    return codecContext;
+}
+
+// Rééchantillonneur vers mono WHISPER_SAMPLE_RATE float, nullptr en cas d'échec
+static SwrContext* createResampler(int channels, AVSampleFormat sampleFormat, int sampleRate) {
+    SwrContext* swrContext = swr_alloc_set_opts(nullptr,
+                                    av_get_default_channel_layout(1), AV_SAMPLE_FMT_FLT, WHISPER_SAMPLE_RATE,
+                                    av_get_default_channel_layout(channels), sampleFormat, sampleRate,
+                                    0, nullptr);
+    if (swrContext && swr_init(swrContext) < 0) {
+        swr_free(&swrContext);
+    }
+    if (!swrContext) {
+        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to initialize the resampling context");
+    }
+    return swrContext;
+}
+
+// Rééchantillonne n_in échantillons (ou vide le tampon de swr si in est nul) à la suite de out,
+// renvoie le nombre d'échantillons ajoutés ou une erreur FFmpeg
+static int resampleAppend(SwrContext* swrContext, const uint8_t** in, int n_in, std::vector<float>& out) {
+    const int n_max = swr_get_out_samples(swrContext, n_in);
+    if (n_max <= 0) {
+        return 0;
+    }
+    const size_t n0 = out.size();
+    out.resize(n0 + n_max);
+    uint8_t* dst = reinterpret_cast<uint8_t*>(out.data() + n0);
+    const int n = swr_convert(swrContext, &dst, n_max, in, n_in);
+    out.resize(n0 + std::max(0, n));
+    return n;
+}
+
+class AudioSource {
+public:
+    virtual ~AudioSource() = default;
+
+    // Copie les n prochains échantillons dans dst. Renvoie n, moins en fin de flux, 0 à la fin et -1 en cas d'erreur
+    int read(float* dst, int n) {
+        int n_done = 0;
+        while (n_done < n) {
+            if (m_pos == m_buf.size() && !refill()) {
+                break;
+            }
+            const int k = std::min<size_t>(n - n_done, m_buf.size() - m_pos);
+            memcpy(dst + n_done, m_buf.data() + m_pos, k*sizeof(float));
+            m_pos  += k;
+            n_done += k;
+        }
+        return n_done == 0 && m_error ? -1 : n_done;
+    }
+
+    // Se place au plus près avant l'échantillon sample, position() donne l'endroit exact atteint
+    bool seek(int64_t sample) {
+        m_buf.clear();
+        m_pos = 0;
+        m_buf_pos = sample;
+        m_eof = m_error = false;
+        return seekTo(sample);
+    }
+
+    // Position du prochain échantillon lu, d'après les timestamps après un seek
+    int64_t position() {
+        if (m_pos == m_buf.size()) {
+            refill();
+        }
+        return m_buf_pos + m_pos;
+    }
+
+    // Nombre total d'échantillons annoncé par le fichier, 0 si inconnu
+    int64_t expectedSamples() const {
+        return m_n_expected;
+    }
+
+    // Vrai si seek() peut aboutir, sans se déplacer dans le fichier
+    virtual bool seekable() const {
+        return false;
+    }
+
+    // Nouvelle source sur le même fichier, lue indépendamment de celle-ci mais qui partage avec elle ce qui est
+    // coûteux à construire (table de seek MP3). nullptr si la source n'a rien à partager: openAudioSource() suffit
+    virtual std::unique_ptr<AudioSource> reopen() {
+        return nullptr;
+    }
+
+protected:
+    // Ajoute au moins un échantillon à out et renvoie leur nombre, 0 en fin de flux ou < 0 en cas d'erreur.
+    // pos reçoit la position du premier échantillon ajouté quand elle ne suit pas le bloc précédent (après un seek)
+    virtual int fill(std::vector<float>& out, int64_t& pos) = 0;
+
+    virtual bool seekTo(int64_t /* sample */) {
+        return false;
+    }
+
+    int64_t m_n_expected = 0;
+
+private:
+    bool refill() {
+        m_buf_pos += m_buf.size();
+        m_buf.clear();
+        m_pos = 0;
+        if (m_eof || m_error) {
+            return false;
+        }
+        int64_t pos = -1;
+        const int ret = fill(m_buf, pos);
+        if (ret <= 0) {
+            m_buf.clear();
+            m_eof   = ret == 0;
+            m_error = ret < 0;
+            return false;
+        }
+        if (pos >= 0) {
+            m_buf_pos = pos;
+        }
+        return true;
+    }
+
+    std::vector<float> m_buf;  // dernier bloc décodé, lu à partir de m_pos
+    size_t m_pos = 0;
+    int64_t m_buf_pos = 0;     // position de m_buf[0]
+    bool m_eof = false;
+    bool m_error = false;
+};
+
+// Tout ce que FFmpeg sait lire; un seul AVPacket et une seule AVFrame pour tout le fichier
+class FFmpegAudioSource : public AudioSource {
+public:
+    static std::unique_ptr<AudioSource> open(const char* path) {
+        std::unique_ptr<FFmpegAudioSource> source(new FFmpegAudioSource());
+        if (!source->init(path)) {
+            return nullptr;
+        }
+        return std::unique_ptr<AudioSource>(source.release());
+    }
+
+    ~FFmpegAudioSource() override {
+        av_packet_free(&m_packet);
+        av_frame_free(&m_frame);
+        swr_free(&m_swr);
+        avcodec_free_context(&m_codec);
+        avformat_close_input(&m_format);
+    }
+
+    bool seekable() const override {
+        return m_format->pb && (m_format->pb->seekable & AVIO_SEEKABLE_NORMAL);
+    }
+
+protected:
+    int fill(std::vector<float>& out, int64_t& pos) override {
+        while (true) {
+            int ret = avcodec_receive_frame(m_codec, m_frame);
+            if (ret >= 0) {
+                if (m_seeking) {
+                    if (m_frame->best_effort_timestamp == AV_NOPTS_VALUE) {
+                        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "No timestamp after seeking");
+                        return -1;
+                    }
+                    pos = av_rescale_q(m_frame->best_effort_timestamp - m_start_time, m_stream->time_base, AVRational{ 1, WHISPER_SAMPLE_RATE });
+                    m_seeking = false;
+                }
+                const int n = resampleAppend(m_swr, (const uint8_t**) m_frame->extended_data, m_frame->nb_samples, out);
+                av_frame_unref(m_frame);
+                if (n < 0) {
+                    __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Error while resampling: %s", av_err2str(n));
+                    return -1;
+                }
+                if (n > 0) {
+                    return n;
+                }
+                continue;
+            }
+            if (ret == AVERROR_EOF) {
+                // Vider le rééchantillonneur, une seule fois
+                if (m_drained) {
+                    return 0;
+                }
+                m_drained = true;
+                const int n = resampleAppend(m_swr, nullptr, 0, out);
+                return n < 0 ? -1 : n;
+            }
+            if (ret != AVERROR(EAGAIN)) {
+                __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Error during decoding: %s", av_err2str(ret));
+                return -1;
+            }
+
+            // Le décodeur attend un paquet, ou d'être vidé en fin de fichier
+            if (av_read_frame(m_format, m_packet) < 0) {
+                avcodec_send_packet(m_codec, nullptr);
+                continue;
+            }
+            if (m_packet->stream_index == m_index) {
+                ret = avcodec_send_packet(m_codec, m_packet);
+                if (ret < 0) {
+                    __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Error sending a packet for decoding: %s", av_err2str(ret));
+                    av_packet_unref(m_packet);
+                    return -1;
+                }
+            }
+            av_packet_unref(m_packet);
+        }
+    }
+
+    bool seekTo(int64_t sample) override {
+        const int64_t ts = m_start_time + av_rescale_q(sample, AVRational{ 1, WHISPER_SAMPLE_RATE }, m_stream->time_base);
+        int ret = av_seek_frame(m_format, m_index, ts, AVSEEK_FLAG_BACKWARD);
+        if (ret < 0) {
+            __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to seek: %s", av_err2str(ret));
+            return false;
+        }
+        // Oublier l'état du décodeur et du rééchantillonneur d'avant le seek
+        avcodec_flush_buffers(m_codec);
+        swr_free(&m_swr);
+        m_swr = createResampler(m_codec->channels, m_codec->sample_fmt, m_codec->sample_rate);
+        m_seeking = true;
+        m_drained = false;
+        return m_swr != nullptr;
+    }
+
+private:
+    bool init(const char* path) {
+        m_format = openSourceFile(path);
+        if (!m_format) {
+            return false;
+        }
+        m_index = findAudioStreamIndex(m_format);
+        if (m_index < 0) {
+            return false;
+        }
+        m_codec = initializeAudioDecoder(m_format, m_index);
+        if (!m_codec) {
+            return false;
+        }
+        m_swr = createResampler(m_codec->channels, m_codec->sample_fmt, m_codec->sample_rate);
+        m_frame  = av_frame_alloc();
+        m_packet = av_packet_alloc();
+        if (!m_swr || !m_frame || !m_packet) {
+            return false;
+        }
+
+        m_stream = m_format->streams[m_index];
+        m_start_time = m_stream->start_time != AV_NOPTS_VALUE ? m_stream->start_time : 0;
+        if (m_stream->duration != AV_NOPTS_VALUE && m_stream->duration > 0) {
+            m_n_expected = av_rescale_q(m_stream->duration, m_stream->time_base, AVRational{ 1, WHISPER_SAMPLE_RATE });
+        } else if (m_format->duration > 0) {
+            m_n_expected = av_rescale(m_format->duration, WHISPER_SAMPLE_RATE, AV_TIME_BASE);
+        }
+        return true;
+    }
+
+    AVFormatContext* m_format = nullptr;
+    AVCodecContext* m_codec = nullptr;
+    const AVStream* m_stream = nullptr;
+    SwrContext* m_swr = nullptr;
+    AVFrame* m_frame = nullptr;
+    AVPacket* m_packet = nullptr;
+
+    int m_index = -1;
+    int64_t m_start_time = 0;
+    bool m_seeking = false;
+    bool m_drained = false;
+};
+
+// Décodeurs qui rendent des trames float entrelacées à leur fréquence d'origine (dr_wav, dr_mp3),
+// mixées en mono puis rééchantillonnées par whisper_resampler
+class ResampledAudioSource : public AudioSource {
+public:
+    // dr_wav, dr_mp3 et le WAV mappé lisent un fichier local
+    bool seekable() const override {
+        return true;
+    }
+
+protected:
+    // Lit au plus n trames entrelacées dans dst, renvoie le nombre lu
+    virtual int readFrames(float* dst, int n) = 0;
+    virtual bool seekFrame(uint64_t frame) = 0;
+
+    // Lit au plus n trames mixées en mono dans dst: readFrames() puis whisper_downmix() par défaut
+    virtual int readMono(float* dst, int n) {
+        if (m_channels == 1) {
+            return readFrames(dst, n);
+        }
+        const int n_in = readFrames(m_frames.data(), n);
+        if (n_in > 0) {
+            whisper_downmix(m_frames.data(), WHISPER_SAMPLE_F32, m_channels, n_in, dst);
+        }
+        return n_in;
+    }
+
+    // Mixage mono et rééchantillonnage natifs (whisper_resampler), sans swr
+    bool initResampler(int channels, int sampleRate, uint64_t n_frames) {
+        if (channels <= 0 || channels > WHISPER_MAX_CHANNELS || sampleRate <= 0) {
+            return false;
+        }
+        m_channels = channels;
+        m_frames.resize(channels > 1 ? (size_t) AUDIO_SOURCE_READ_FRAMES*channels : 0);
+        m_mono.resize(AUDIO_SOURCE_READ_FRAMES);
+        m_resampler = std::make_unique<whisper_resampler>(sampleRate);
+        m_n_expected = m_resampler->n_out((int64_t) n_frames);
+        return true;
+    }
+
+    int fill(std::vector<float>& out, int64_t& pos) override {
+        if (m_seek_pos >= 0) {
+            pos = m_seek_pos;
+            m_seek_pos = -1;
+        }
+        const size_t n_before = out.size();
+        while (out.size() == n_before) {
+            const int n_in = readMono(m_mono.data(), AUDIO_SOURCE_READ_FRAMES);
+            if (n_in <= 0) {
+                if (m_drained) {
+                    return 0;
+                }
+                m_drained = true;
+                m_resampler->flush(out);
+                return (int) (out.size() - n_before);
+            }
+            m_resampler->push(m_mono.data(), n_in, out);
+        }
+        return (int) (out.size() - n_before);
+    }
+
+    // La trame visée tombe sur la grille commune aux deux fréquences: la position atteinte est exacte
+    // (jusqu'à l - 1 échantillons avant sample) et passe par fill() au lieu de la position demandée
+    bool seekTo(int64_t sample) override {
+        int64_t pos = 0;
+        const int64_t frame = m_resampler->seek_input(sample, pos);
+        if (!seekFrame((uint64_t) frame)) {
+            return false;
+        }
+        m_resampler->reset();
+        m_drained = false;
+        m_seek_pos = pos;
+        return true;
+    }
+
+private:
+    std::unique_ptr<whisper_resampler> m_resampler;
+    std::vector<float> m_frames;
+    std::vector<float> m_mono;
+    int m_channels = 1;
+    bool m_drained = false;
+    int64_t m_seek_pos = -1; // position du prochain bloc après un seek
+};
+
+// WAV lu dans le fichier mappé (voir whisper_wav_map): en 16 kHz int16 mono/stéréo ou float mono les
+// échantillons sont utilisés tels quels, sinon (int16/24/32 ou float, toute fréquence, jusqu'à
+// WHISPER_MAX_CHANNELS canaux) ils sont mixés par whisper_downmix() puis rééchantillonnés.
+// dr_wav décode les autres formats
+class WavAudioSource : public ResampledAudioSource {
+public:
+    static std::unique_ptr<AudioSource> open(const std::string& path) {
+        whisper_wav_map map;
+        if (whisper_wav_map_open(path, map)) {
+            return open(std::move(map));
+        }
+
+        std::unique_ptr<WavAudioSource> source(new WavAudioSource());
+        if (!drwav_init_file(&source->m_wav, path.c_str(), nullptr)) {
+            return nullptr;
+        }
+        source->m_wav_open = true;
+        if (!source->initResampler(source->m_wav.channels, source->m_wav.sampleRate, source->m_wav.totalPCMFrameCount)) {
+            return nullptr;
+        }
+        return std::unique_ptr<AudioSource>(source.release());
+    }
+
+    // Fichier déjà mappé par whisper_wav_map_open()
+    static std::unique_ptr<AudioSource> open(whisper_wav_map map) {
+        std::unique_ptr<WavAudioSource> source(new WavAudioSource());
+        source->m_map = std::move(map);
+        if (whisper_wav_map_direct(source->m_map)) {
+            source->m_n_expected = source->m_map.pcm.n_samples;
+        } else if (!source->initResampler(source->m_map.n_channels, source->m_map.sample_rate, source->m_map.n_frames)) {
+            return nullptr;
+        }
+        return std::unique_ptr<AudioSource>(source.release());
+    }
+
+    ~WavAudioSource() override {
+        if (m_wav_open) {
+            drwav_uninit(&m_wav);
+        }
+    }
+
+protected:
+    int fill(std::vector<float>& out, int64_t& pos) override {
+        if (!whisper_wav_map_direct(m_map)) {
+            return ResampledAudioSource::fill(out, pos);
+        }
+        const int n = std::min<int64_t>(WHISPER_SAMPLE_RATE, m_map.pcm.n_samples - m_offset);
+        if (n <= 0) {
+            return 0;
+        }
+        out.resize(n);
+        whisper_pcm_read(m_map.pcm, m_offset, n, out.data());
+        m_offset += n;
+        whisper_wav_map_drop(m_map, m_offset);
+        return n;
+    }
+
+    bool seekTo(int64_t sample) override {
+        if (!whisper_wav_map_direct(m_map)) {
+            return ResampledAudioSource::seekTo(sample);
+        }
+        m_offset = std::max<int64_t>(0, std::min<int64_t>(sample, m_map.pcm.n_samples));
+        return true;
+    }
+
+    int readMono(float* dst, int n) override {
+        if (!m_map.mapping) {
+            return ResampledAudioSource::readMono(dst, n);
+        }
+        const int n_read = std::min<int64_t>(n, m_map.n_frames - m_offset);
+        if (n_read <= 0) {
+            return 0;
+        }
+        const size_t frame_size = (size_t) whisper_sample_size(m_map.format)*m_map.n_channels;
+        whisper_downmix(m_map.data + m_offset*frame_size, m_map.format, m_map.n_channels, n_read, dst);
+        m_offset += n_read;
+        whisper_wav_map_drop(m_map, m_offset);
+        return n_read;
+    }
+
+    int readFrames(float* dst, int n) override {
+        return (int) drwav_read_pcm_frames_f32(&m_wav, n, dst);
+    }
+
+    bool seekFrame(uint64_t frame) override {
+        if (m_map.mapping) {
+            m_offset = std::min<int64_t>(frame, m_map.n_frames);
+            return true;
+        }
+        return drwav_seek_to_pcm_frame(&m_wav, frame);
+    }
+
+private:
+    whisper_wav_map m_map;
+    int64_t m_offset = 0; // en trames du fichier mappé
+
+    drwav m_wav;
+    bool m_wav_open = false;
+};
+
+// MP3 par dr_mp3, sans FFmpeg
+class Mp3AudioSource : public ResampledAudioSource {
+public:
+    static std::unique_ptr<AudioSource> open(const std::string& path) {
+        std::unique_ptr<Mp3AudioSource> source(new Mp3AudioSource());
+        if (!drmp3_init_file(&source->m_mp3, path.c_str(), nullptr)) {
+            return nullptr;
+        }
+        source->m_mp3_open = true;
+        source->m_path = path;
+        if (!source->initResampler(source->m_mp3.channels, source->m_mp3.sampleRate, 0)) {
+            return nullptr;
+        }
+        // Compter les trames demanderait de parcourir tout le fichier: la durée est estimée d'après le débit
+        source->m_n_expected = estimateSamples(path);
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0) {
+            source->m_file_size = st.st_size;
+        }
+        return std::unique_ptr<AudioSource>(source.release());
+    }
+
+    ~Mp3AudioSource() override {
+        if (m_mp3_open) {
+            drmp3_uninit(&m_mp3);
+        }
+    }
+
+    // La table de seek est construite ici une fois pour toutes et liée telle quelle à la nouvelle source:
+    // dr_mp3 ne fait que la lire
+    std::unique_ptr<AudioSource> reopen() override {
+        buildSeekTable();
+        std::unique_ptr<AudioSource> other = open(m_path);
+        if (other && m_seek_points) {
+            Mp3AudioSource* mp3 = static_cast<Mp3AudioSource*>(other.get());
+            mp3->m_seek_table  = true;
+            mp3->m_seek_points = m_seek_points;
+            drmp3_bind_seek_table(&mp3->m_mp3, (drmp3_uint32) m_seek_points->size(), m_seek_points->data());
+        }
+        return other;
+    }
+
+protected:
+    int readFrames(float* dst, int n) override {
+        return (int) drmp3_read_pcm_frames_f32(&m_mp3, n, dst);
+    }
+
+    bool seekFrame(uint64_t frame) override {
+        if (frame > 0) {
+            buildSeekTable();
+        }
+        return drmp3_seek_to_pcm_frame(&m_mp3, frame);
+    }
+
+private:
+    // Sans table dr_mp3 décode tout depuis le début jusqu'à la trame visée. La table ne demande que de lire
+    // les en-têtes de trames, elle est construite au premier seek ou reopen(). Sa taille vient de celle du
+    // fichier et non de la durée estimée, qui peut être nulle (pas de trame valide au début) ou fausse en VBR
+    void buildSeekTable() {
+        if (m_seek_table) {
+            return;
+        }
+        m_seek_table = true;
+        drmp3_uint32 count = (drmp3_uint32) std::min<int64_t>(AUDIO_SOURCE_MP3_SEEK_POINTS, m_file_size/AUDIO_SOURCE_MP3_SEEK_BYTES + 1);
+        auto points = std::make_shared<std::vector<drmp3_seek_point>>(count);
+        if (drmp3_calculate_seek_points(&m_mp3, &count, points->data()) && count > 0) {
+            points->resize(count);
+            drmp3_bind_seek_table(&m_mp3, count, points->data());
+            m_seek_points = std::move(points);
+        }
+    }
+
+    // Durée d'après la taille du fichier et le débit de la première trame, exacte en CBR
+    static int64_t estimateSamples(const std::string& path) {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (!f) {
+            return 0;
+        }
+        uint8_t hdr[10];
+        long offset = 0;
+        if (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr) && memcmp(hdr, "ID3", 3) == 0) {
+            offset = 10 + ((hdr[6] & 0x7f) << 21 | (hdr[7] & 0x7f) << 14 | (hdr[8] & 0x7f) << 7 | (hdr[9] & 0x7f));
+        }
+        fseek(f, 0, SEEK_END);
+        const long size = ftell(f);
+
+        uint8_t buf[4096];
+        size_t n = 0;
+        if (fseek(f, offset, SEEK_SET) == 0) {
+            n = fread(buf, 1, sizeof(buf), f);
+        }
+        fclose(f);
+
+        for (size_t i = 0; i + 4 <= n; i++) {
+            if (drmp3_hdr_valid(buf + i) && drmp3_hdr_bitrate_kbps(buf + i) > 0) {
+                // bits/(kbps*1000) secondes
+                return (int64_t) (size - offset - i)*8*WHISPER_SAMPLE_RATE/(drmp3_hdr_bitrate_kbps(buf + i)*1000);
+            }
+        }
+        return 0;
+    }
+
+    drmp3 m_mp3;
+    bool m_mp3_open = false;
+    int64_t m_file_size = 0;
+    std::string m_path;
+    std::shared_ptr<std::vector<drmp3_seek_point>> m_seek_points; // référencée par m_mp3, partagée par reopen()
+    bool m_seek_table = false;
+};
+
+// Extrait [start, end) d'une autre source, en échantillons 16 kHz. La source est placée au plus près
+// avant start - AUDIO_SOURCE_PREROLL (av_seek_frame, seek dr_wav / dr_mp3 ou position dans le fichier
+// mappé), l'audio est décodé et jeté jusqu'à start exactement, et la lecture s'arrête à end
+class RangeAudioSource : public AudioSource {
+public:
+    static std::unique_ptr<AudioSource> open(std::unique_ptr<AudioSource> source, int64_t start, int64_t end) {
+        if (!source || start < 0 || end <= start) {
+            return nullptr;
+        }
+        if (start > 0 && !source->seek(std::max<int64_t>(0, start - AUDIO_SOURCE_PREROLL))) {
+            return nullptr;
+        }
+
+        std::vector<float> skip(AUDIO_SOURCE_READ_FRAMES);
+        int64_t pos;
+        while ((pos = source->position()) < start) {
+            const int n = source->read(skip.data(), (int) std::min<int64_t>(skip.size(), start - pos));
+            if (n < 0) {
+                return nullptr;
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        if (pos > start) {
+            __android_log_print(ANDROID_LOG_WARN, "Audio Conversion", "Seek landed %lld samples after the range start",
+                                (long long) (pos - start));
+        }
+
+        std::unique_ptr<RangeAudioSource> range(new RangeAudioSource());
+        range->m_source = std::move(source);
+        range->m_remaining = end - std::max(pos, start);
+        range->m_n_expected = end == INT64_MAX ? 0 : end - start;
+        if (range->m_source->expectedSamples() > 0) {
+            range->m_n_expected = std::max<int64_t>(0, std::min(end, range->m_source->expectedSamples()) - start);
+        }
+        return std::unique_ptr<AudioSource>(range.release());
+    }
+
+protected:
+    int fill(std::vector<float>& out, int64_t& /* pos */) override {
+        const int n = (int) std::min<int64_t>(WHISPER_SAMPLE_RATE, m_remaining);
+        if (n <= 0) {
+            return 0;
+        }
+        out.resize(n);
+        const int n_read = m_source->read(out.data(), n);
+        out.resize(std::max(0, n_read));
+        m_remaining -= std::max(0, n_read);
+        return n_read;
+    }
+
+private:
+    std::unique_ptr<AudioSource> m_source;
+    int64_t m_remaining = 0;
+};
+
+// Choisit le décodeur d'après le contenu du fichier: dr_wav pour le WAV, dr_mp3 pour le MP3,
+// FFmpeg pour tout le reste ou si le décodeur dédié refuse le fichier
+static std::unique_ptr<AudioSource> openAudioSource(const std::string& path) {
+    uint8_t magic[12] = {};
+    if (FILE* f = fopen(path.c_str(), "rb")) {
+        fread(magic, 1, sizeof(magic), f);
+        fclose(f);
+    }
+
+    std::unique_ptr<AudioSource> source;
+    if (memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0) {
+        source = WavAudioSource::open(path);
+    } else if (memcmp(magic, "ID3", 3) == 0 || drmp3_hdr_valid(magic)) {
+        source = Mp3AudioSource::open(path);
+    }
+    if (!source) {
+        source = FFmpegAudioSource::open(path.c_str());
+    }
+    return source;
+}
@@ -1,6 +1,7 @@
 #include <jni.h>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -24,6 +25,7 @@ extern "C" {
 #include "tensorflow/lite/model.h"
 #include "tensorflow/lite/optional_debug_tools.h"
 #include "whisper.h"
+#include "audio_source.h"
 #include "input_features.h"
 #include "tensorflow/lite/delegates/gpu/delegate.h"
 #include <fstream>
@@ -41,6 +43,7 @@ extern "C" {
 
 #define WAVE_SAMPLE_RATE        16000
 #define AVIO_CTX_BUF_SZ          4096
+#define WAVE_WRITE_BUF_SZ       (256 * 1024)
 #define TARGET_CHANNELS 1
 #define TARGET_SAMPLE_RATE 16000
 #define TARGET_SAMPLE_FORMAT AV_SAMPLE_FMT_S16
@@ -88,12 +91,6 @@ struct audio_buffer {
     int size; /* size left in the buffer */
 };
 
-// Définir la structure pour les paramètres
-struct Params {
-    std::vector<std::vector<float>> segments;
-    std::function<void(const std::string&)> callback;
-};
-
 // Variable globale pour l'environnement Java
 JavaVM* g_JavaVM = nullptr;
 jobject g_Callback = nullptr;
@@ -103,7 +100,7 @@ extern "C" JNIEXPORT jint JNI_OnLoad(JavaVM* vm, void* reserved) {
     return JNI_VERSION_1_6;  // la version de JNI que votre code supporte
 }
 
-static void write_wave_hdr(int fd, size_t size)
+static void write_wave_hdr(int fd, size_t size, bool is_float)
 {
     struct wave_hdr wh;
 
@@ -112,359 +109,678 @@ static void write_wave_hdr(int fd, size_t size)
     memcpy(&wh.wav_header, "WAVE", 4);
     memcpy(&wh.fmt_header, "fmt ", 4);
     wh.fmt_chunk_size = 16;
-    wh.audio_format = 1;
+    wh.audio_format = is_float ? 3 : 1;
     wh.num_channels = 1;
     wh.sample_rate = WAVE_SAMPLE_RATE;
-    wh.sample_alignment = 2;
-    wh.bit_depth = 16;
+    wh.sample_alignment = is_float ? 4 : 2;
+    wh.bit_depth = is_float ? 32 : 16;
     wh.byte_rate = wh.sample_rate * wh.sample_alignment;
     memcpy(&wh.data_header, "data", 4);
     wh.data_bytes = size;
 
-    write(fd, &wh, sizeof(struct wave_hdr));
+    pwrite(fd, &wh, sizeof(struct wave_hdr), 0);
 }
 
-AVFormatContext* openSourceFile(const char* sourceFilePath) {
-    AVFormatContext* formatContext = nullptr;
-
-    // Ouvrir le fichier source
-    int result = avformat_open_input(&formatContext, sourceFilePath, nullptr, nullptr);
-    if (result < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to open source file: %s", av_err2str(result));
-        return nullptr;
+// Écriture bufferisée du WAV de sortie: la source écrit directement dans un tampon de taille fixe,
+// vidé dans le fichier par gros blocs, la mémoire utilisée ne dépend pas de la durée du fichier
+struct wave_writer {
+    int fd = -1;
+    std::vector<uint8_t> buffer;
+    size_t used = 0;
+    size_t data_bytes = 0;
+
+    bool flush() {
+        size_t done = 0;
+        while (done < used) {
+            ssize_t n = write(fd, buffer.data() + done, used - done);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            done += n;
+        }
+        data_bytes += used;
+        used = 0;
+        return true;
     }
 
-    // Récupérer les informations sur les flux dans le fichier source
-    result = avformat_find_stream_info(formatContext, nullptr);
-    if (result < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to retrieve source stream info: %s", av_err2str(result));
-        avformat_close_input(&formatContext);
-        return nullptr;
+    // Place libre pour au moins n octets à la fin du tampon
+    uint8_t* reserve(size_t n) {
+        if (used + n > buffer.size()) {
+            if (!flush()) {
+                return nullptr;
+            }
+            if (n > buffer.size()) {
+                buffer.resize(n);
+            }
+        }
+        return buffer.data() + used;
     }
+};
 
-    return formatContext;
-}
+extern "C" JNIEXPORT jint JNICALL
+Java_com_example_audio2text_MyApplication_freeModelJNI(
+        JNIEnv* env,
+        jobject /* this */) {
+    if(g_whisper_tflite_params.buffer){
+        __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR",
+                            "%s: free buffer %x memory\n", __func__,
+                            g_whisper_tflite_params.buffer);
+        free(g_whisper_tflite_params.buffer);
 
-int findAudioStreamIndex(AVFormatContext* formatContext) {
-    // Trouver l'index du flux audio
-    int audioStreamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
-    if (audioStreamIndex < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to find an audio stream in the source file");
-        return -1;
     }
+    env->DeleteGlobalRef(g_Callback);
+    return 0;
+}
 
-    return audioStreamIndex;
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_example_audio2text_MyApplication_setFftBackendJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring backendName) {
+    const char* name = env->GetStringUTFChars(backendName, nullptr);
+    bool ok;
+    if (strcmp(name, "auto") == 0) {
+        // Choisir le backend le plus rapide sur ce CPU
+        whisper_fft_backend_select_fastest();
+        ok = true;
+    } else {
+        ok = whisper_fft_backend_select(name);
+    }
+    __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "FFT backend %s: %s", ok ? "selected" : "unavailable",
+                        ok ? whisper_fft_backend_names[g_whisper_fft_backend.load()] : name);
+    env->ReleaseStringUTFChars(backendName, name);
+    return ok ? JNI_TRUE : JNI_FALSE;
 }
 
-AVCodecContext* initializeAudioDecoder(AVFormatContext* formatContext, int audioStreamIndex) {
-    // Récupérer le codec paramètres pour le flux audio
-    AVCodecParameters* codecParameters = formatContext->streams[audioStreamIndex]->codecpar;
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_example_audio2text_MyApplication_setMelMethodJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring methodName) {
+    const char* name = env->GetStringUTFChars(methodName, nullptr);
+    bool ok = whisper_mel_method_select(name);
+    __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Mel method %s: %s", ok ? "selected" : "unknown",
+                        ok ? whisper_mel_method_names[g_whisper_mel_method.load()] : name);
+    env->ReleaseStringUTFChars(methodName, name);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
 
-    // Trouver le décodeur pour le codec
-    auto* codec = const_cast<AVCodec *>(avcodec_find_decoder(codecParameters->codec_id));
-    if (!codec) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to find decoder for audio stream");
-        return nullptr;
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_benchmarkFftJNI(
+        JNIEnv* env,
+        jobject /* this */) {
+    std::string report;
+    for (const auto& res : whisper_fft_benchmark()) {
+        char line[128];
+        if (res.available) {
+            snprintf(line, sizeof(line), "%s: %.0f ns/frame (max err %.2e)\n",
+                     whisper_fft_backend_names[res.type], res.ns_per_frame, res.max_err);
+        } else {
+            snprintf(line, sizeof(line), "%s: unavailable\n", whisper_fft_backend_names[res.type]);
+        }
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "FFT benchmark %s", line);
+        report += line;
     }
-
-    // Allouer un contexte de codec et l'initialiser avec les paramètres du codec
-    AVCodecContext* codecContext = avcodec_alloc_context3(codec);
-    if (!codecContext) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to allocate codec context");
-        return nullptr;
+    // Le spectrogramme complet, FFT trame par trame contre produit matriciel par blocs
+    if (filters.data.empty()) {
+        report += "mel: filters not loaded\n";
+    } else {
+        for (const auto& res : whisper_mel_benchmark(filters)) {
+            char line[128];
+            snprintf(line, sizeof(line), "mel %s: %.0f ns/frame (max err %.2e)\n",
+                     whisper_mel_method_names[res.method], res.ns_per_frame, res.max_err);
+            __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Mel benchmark %s", line);
+            report += line;
+        }
     }
+    return env->NewStringUTF(report.c_str());
+}
 
-    // Initialiser le contexte du codec avec les paramètres du codec
-    int result = avcodec_parameters_to_context(codecContext, codecParameters);
-    if (result < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to initialize codec context: %s", av_err2str(result));
-        avcodec_free_context(&codecContext);
-        return nullptr;
+// Décode tout le fichier par blocs d'une seconde et ajoute une ligne au rapport: délai avant le premier
+// bloc (ouverture comprise) et débit en échantillons 16 kHz par seconde
+static void benchmarkDecode(const char* name, const std::function<std::unique_ptr<AudioSource>()>& open, std::string& report) {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::unique_ptr<AudioSource> source = open();
+    char line[160];
+    if (!source) {
+        snprintf(line, sizeof(line), "%s: unavailable\n", name);
+        report += line;
+        return;
     }
 
-    // Ouvrir le codec
-    result = avcodec_open2(codecContext, codec, nullptr);
-    if (result < 0) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to open codec: %s", av_err2str(result));
-        avcodec_free_context(&codecContext);
-        return nullptr;
+    std::vector<float> block(WHISPER_SAMPLE_RATE);
+    double first_ms = 0.0;
+    int64_t n_samples = 0;
+    int n;
+    while ((n = source->read(block.data(), (int) block.size())) > 0) {
+        if (n_samples == 0) {
+            first_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        n_samples += n;
     }
+    const double total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
 
-    return codecContext;
+    if (n < 0) {
+        snprintf(line, sizeof(line), "%s: decoding error after %lld samples\n", name, (long long) n_samples);
+    } else {
+        snprintf(line, sizeof(line), "%s: first block %.1f ms, %.0f samples/s (%.0fx realtime, %.1f s of audio)\n",
+                 name, first_ms, n_samples/total_s, n_samples/(total_s*WHISPER_SAMPLE_RATE),
+                 (double) n_samples/WHISPER_SAMPLE_RATE);
+    }
+    __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Decode benchmark %s", line);
+    report += line;
 }
 
-std::vector<AVFrame*> decodeAudioPackets(AVFormatContext* formatContext, int audioStreamIndex, AVCodecContext* codecContext) {
-    std::vector<AVFrame*> frames;
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_benchmarkDecodeJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring inputFilePath) {
+    const char* inputPath = env->GetStringUTFChars(inputFilePath, nullptr);
+    const std::string path(inputPath);
+    env->ReleaseStringUTFChars(inputFilePath, inputPath);
 
-    AVPacket* packet = av_packet_alloc();
-    if (!packet) {
-        __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to allocate packet");
-        return frames;
-    }
+    // Le décodeur natif (dr_mp3 ou dr_wav + whisper_resampler) contre FFmpeg + swr sur le même fichier
+    std::string report;
+    benchmarkDecode("mp3 (dr_mp3)", [&]() { return Mp3AudioSource::open(path); }, report);
+    benchmarkDecode("wav (dr_wav)", [&]() { return WavAudioSource::open(path); }, report);
+    benchmarkDecode("ffmpeg", [&]() { return FFmpegAudioSource::open(path.c_str()); }, report);
+    return env->NewStringUTF(report.c_str());
+}
 
-    while (av_read_frame(formatContext, packet) >= 0) {
-        // Ignorer les paquets qui ne proviennent pas du flux audio
-        if (packet->stream_index != audioStreamIndex) {
-            av_packet_unref(packet);
-            continue;
+// Rapport signal/bruit en dB de out face à ref, au meilleur décalage (swr et whisper_resampler n'ont pas
+// le même retard), sans les bords où les filtres voient des zéros
+static double resamplerSnr(const std::vector<float>& out, const std::vector<float>& ref) {
+    const int margin = 256;
+    double best = -1e9;
+    for (int lag = -32; lag <= 32; lag++) {
+        double signal = 0.0, noise = 0.0;
+        for (int j = margin; j + margin < (int) ref.size(); j++) {
+            if (j + lag < 0 || j + lag >= (int) out.size()) {
+                continue;
+            }
+            const double e = out[j + lag] - ref[j];
+            signal += (double) ref[j]*ref[j];
+            noise  += e*e;
         }
-
-        // Envoyer le paquet au décodeur
-        int result = avcodec_send_packet(codecContext, packet);
-        if (result < 0) {
-            __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to send packet to decoder: %s", av_err2str(result));
-            av_packet_unref(packet);
-            continue;
+        if (signal > 0.0) {
+            best = std::max(best, 10.0*log10(signal/std::max(noise, 1e-30)));
         }
+    }
+    return best;
+}
 
-        // Recevoir tous les frames du paquet
-        while (result >= 0) {
-            AVFrame* frame = av_frame_alloc();
-            if (!frame) {
-                __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to allocate frame");
-                break;
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_benchmarkResamplerJNI(
+        JNIEnv* env,
+        jobject /* this */) {
+    struct config {
+        int rate;
+        int channels;
+        whisper_sample_format format;
+        AVSampleFormat av_format; // int24 est passé à swr en int32 (FFmpeg n'a pas d'int24 compact)
+        const char* name;
+    };
+    const config configs[] = {
+        {  8000, 1, WHISPER_SAMPLE_S16, AV_SAMPLE_FMT_S16, "s16" },
+        { 22050, 2, WHISPER_SAMPLE_S16, AV_SAMPLE_FMT_S16, "s16" },
+        { 44100, 2, WHISPER_SAMPLE_S16, AV_SAMPLE_FMT_S16, "s16" },
+        { 44100, 1, WHISPER_SAMPLE_S32, AV_SAMPLE_FMT_S32, "s32" },
+        { 48000, 2, WHISPER_SAMPLE_S24, AV_SAMPLE_FMT_S32, "s24" },
+        { 48000, 6, WHISPER_SAMPLE_F32, AV_SAMPLE_FMT_FLT, "f32" },
+    };
+    const int seconds = 10;
+    const int block   = AUDIO_SOURCE_READ_FRAMES;
+
+    // 440 Hz + 3 kHz, identiques sur tous les canaux: le mixage mono doit redonner le même signal
+    auto tone = [](double t) {
+        return 0.4*sin(2.0*M_PI*440.0*t) + 0.4*sin(2.0*M_PI*3000.0*t);
+    };
+
+    std::string report;
+    for (const config& c : configs) {
+        const int n_frames = c.rate*seconds;
+        const int sample_size = whisper_sample_size(c.format);
+        std::vector<uint8_t> input((size_t) n_frames*c.channels*sample_size);
+        std::vector<int32_t> input_s32; // copie int32 de l'int24 pour swr
+        if (c.format == WHISPER_SAMPLE_S24) {
+            input_s32.resize((size_t) n_frames*c.channels);
+        }
+        for (int i = 0; i < n_frames; i++) {
+            const double v = tone((double) i/c.rate);
+            for (int ch = 0; ch < c.channels; ch++) {
+                const size_t k = (size_t) i*c.channels + ch;
+                if (c.format == WHISPER_SAMPLE_S16) {
+                    ((int16_t*) input.data())[k] = (int16_t) lrint(v*32767.0);
+                } else if (c.format == WHISPER_SAMPLE_S24) {
+                    const int32_t s = (int32_t) lrint(v*8388607.0);
+                    memcpy(input.data() + 3*k, &s, 3);
+                    input_s32[k] = s*256;
+                } else if (c.format == WHISPER_SAMPLE_S32) {
+                    ((int32_t*) input.data())[k] = (int32_t) lrint(v*2147483647.0);
+                } else {
+                    ((float*) input.data())[k] = (float) v;
+                }
             }
+        }
+        const uint8_t* swr_input = input_s32.empty() ? input.data() : (const uint8_t*) input_s32.data();
+        const size_t swr_frame_size = input_s32.empty() ? (size_t) c.channels*sample_size : (size_t) c.channels*sizeof(int32_t);
 
-            result = avcodec_receive_frame(codecContext, frame);
-            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
-                av_frame_free(&frame);
-                break;
-            } else if (result < 0) {
-                __android_log_print(ANDROID_LOG_ERROR, "Audio Conversion", "Failed to receive frame from decoder: %s", av_err2str(result));
-                av_frame_free(&frame);
-                break;
-            }
+        std::vector<float> ref((size_t) n_frames*WHISPER_SAMPLE_RATE/c.rate);
+        for (size_t j = 0; j < ref.size(); j++) {
+            ref[j] = (float) tone((double) j/WHISPER_SAMPLE_RATE);
+        }
 
-            frames.push_back(frame);
+        // whisper_downmix() + whisper_resampler
+        std::vector<float> native;
+        native.reserve(ref.size() + block);
+        std::vector<float> mono(block);
+        auto t0 = std::chrono::steady_clock::now();
+        whisper_resampler resampler(c.rate);
+        for (int i = 0; i < n_frames; i += block) {
+            const int n = std::min(block, n_frames - i);
+            whisper_downmix(input.data() + (size_t) i*c.channels*sample_size, c.format, c.channels, n, mono.data());
+            resampler.push(mono.data(), n, native);
         }
+        resampler.flush(native);
+        const double native_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        // swr_convert, même découpage
+        std::vector<float> swr;
+        swr.reserve(ref.size() + block);
+        t0 = std::chrono::steady_clock::now();
+        SwrContext* swrContext = createResampler(c.channels, c.av_format, c.rate);
+        const bool swr_ok = swrContext != nullptr;
+        if (swr_ok) {
+            for (int i = 0; i < n_frames; i += block) {
+                const uint8_t* in = swr_input + (size_t) i*swr_frame_size;
+                resampleAppend(swrContext, &in, std::min(block, n_frames - i), swr);
+            }
+            resampleAppend(swrContext, nullptr, 0, swr);
+            swr_free(&swrContext);
+        }
+        const double swr_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        char line[192];
+        snprintf(line, sizeof(line), "%d Hz %d ch %s: native %.1f Mframes/s, %.1f dB | swr %.1f Mframes/s, %.1f dB\n",
+                 c.rate, c.channels, c.name,
+                 n_frames/native_s*1e-6, resamplerSnr(native, ref),
+                 swr_ok ? n_frames/swr_s*1e-6 : 0.0, resamplerSnr(swr, ref));
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Resampler benchmark %s", line);
+        report += line;
+    }
+    return env->NewStringUTF(report.c_str());
+}
 
-        av_packet_unref(packet);
+// Conversion float -> int16 avec saturation
+static void floatToS16(const float* src, int n, int16_t* dst) {
+    for (int i = 0; i < n; i++) {
+        const float v = src[i]*32768.0f;
+        dst[i] = (int16_t) lrintf(std::min(32767.0f, std::max(-32768.0f, v)));
     }
+}
 
-    av_packet_free(&packet);
+extern "C" JNIEXPORT jint JNICALL Java_com_example_audio2text_MyApplication_convertTo16kHz(JNIEnv* env, jobject thiz, jstring inputFilePath, jstring outputFilePath, jboolean floatOutput) {
+    const char* inputPath = env->GetStringUTFChars(inputFilePath, nullptr);
+    const char* outputPath = env->GetStringUTFChars(outputFilePath, nullptr);
 
-    return frames;
-}
+    const bool is_float = floatOutput == JNI_TRUE;
+    const int bytesPerSample = is_float ? sizeof(float) : sizeof(int16_t);
+    // Échantillons lus par bloc, écrits directement dans le tampon d'écriture en sortie float
+    const int blockSamples = WAVE_WRITE_BUF_SZ / sizeof(float) / 4;
 
-static void convert_frame(struct SwrContext *swr, AVCodecContext *codec,
-                          AVFrame *frame, int16_t **data, int *size, bool flush)
-{
-    int nr_samples;
-    int64_t delay;
-    uint8_t *buffer;
+    std::unique_ptr<AudioSource> source = openAudioSource(inputPath);
+    std::vector<float> block;
+    wave_writer writer;
+    int ret = -1;
+    bool ok = false;
 
-    delay = swr_get_delay(swr, codec->sample_rate);
-    nr_samples = av_rescale_rnd(delay + (!flush ? frame->nb_samples : 0),
-                                WAVE_SAMPLE_RATE, codec->sample_rate,
-                                AV_ROUND_UP);
-    av_samples_alloc(&buffer, NULL, 1, nr_samples, AV_SAMPLE_FMT_S16, 0);
+    if (!source) {
+        goto end;
+    }
 
-    /*
-     * !flush is used to check if we are flushing any remaining
-     * conversion buffers...
-     */
-    nr_samples = swr_convert(swr, &buffer, nr_samples,
-                             !flush ? (const uint8_t **)frame->data : NULL,
-                             !flush ? frame->nb_samples : 0);
-
-    *data = static_cast<int16_t *>(realloc(*data, (*size + nr_samples) * sizeof(int16_t)));
-    memcpy(*data + *size, buffer, nr_samples * sizeof(int16_t));
-    *size += nr_samples;
-    av_freep(&buffer);
-}
+    writer.fd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (writer.fd < 0) {
+        LOGE("Failed to open output file");
+        goto end;
+    }
+    writer.buffer.resize(WAVE_WRITE_BUF_SZ);
+    if (!is_float) {
+        block.resize(blockSamples);
+    }
 
-extern "C" JNIEXPORT jint JNICALL
-Java_com_example_audio2text_MyApplication_freeModelJNI(
-        JNIEnv* env,
-        jobject /* this */) {
-    if(g_whisper_tflite_params.buffer){
-        __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR",
-                            "%s: free buffer %x memory\n", __func__,
-                            g_whisper_tflite_params.buffer);
-        free(g_whisper_tflite_params.buffer);
+    // L'en-tête est réécrit à la fin, une fois la taille des données connue
+    write_wave_hdr(writer.fd, 0, is_float);
+    if (lseek(writer.fd, sizeof(struct wave_hdr), SEEK_SET) < 0) {
+        LOGE("Failed to write output file");
+        goto end;
+    }
 
+    ok = true;
+    while (ok) {
+        uint8_t* dst = writer.reserve((size_t) blockSamples * bytesPerSample);
+        if (!dst) {
+            LOGE("Failed to write output file");
+            ok = false;
+            break;
+        }
+        const int n = source->read(is_float ? reinterpret_cast<float*>(dst) : block.data(), blockSamples);
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (!is_float) {
+            floatToS16(block.data(), n, reinterpret_cast<int16_t*>(dst));
+        }
+        writer.used += (size_t) n * bytesPerSample;
     }
-    env->DeleteGlobalRef(g_Callback);
-    return 0;
-}
 
-extern "C" JNIEXPORT jint JNICALL Java_com_example_audio2text_MyApplication_convertTo16kHz(JNIEnv* env, jobject thiz, jstring inputFilePath, jstring outputFilePath) {
-    const char* inputPath = env->GetStringUTFChars(inputFilePath, nullptr);
-    const char* outputPath = env->GetStringUTFChars(outputFilePath, nullptr);
+    // Vider le tampon d'écriture
+    if (ok) {
+        ok = writer.flush();
+    }
 
-    AVFormatContext *formatContext = nullptr;
-    int audioStreamIndex = -1;
-    AVCodecContext *codecContext = nullptr;
-    AVFrame *frame = nullptr;
-    SwrContext *swrContext = nullptr;
-    int fd;
-    size_t size;
-    uint8_t *ptr;
-    int16_t *data = nullptr;
-    int dataSize = 0;
-    int ret;
-
-    formatContext = openSourceFile(inputPath);
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi opensourcefile");
-    audioStreamIndex = findAudioStreamIndex(formatContext);
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi findaudiostreamindex");
-    codecContext = initializeAudioDecoder(formatContext, audioStreamIndex);
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi initializeaudioDecoder");
-
-    frame = av_frame_alloc();
-    if (!frame) {
-        LOGE("Failed to allocate frame");
-        return -1;
+    if (ok) {
+        write_wave_hdr(writer.fd, writer.data_bytes, is_float);
+        __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Durée en sec: %f",
+                            (double) writer.data_bytes / bytesPerSample / WAVE_SAMPLE_RATE);
+        ret = 0;
+    }
+
+end:
+    if (writer.fd >= 0) {
+        close(writer.fd);
     }
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi allocate frame");
+    source.reset();
+
+    env->ReleaseStringUTFChars(inputFilePath, inputPath);
+    env->ReleaseStringUTFChars(outputFilePath, outputPath);
 
-    swrContext = swr_alloc_set_opts(nullptr,
-                                    av_get_default_channel_layout(TARGET_CHANNELS), TARGET_SAMPLE_FORMAT, TARGET_SAMPLE_RATE,
-                                    av_get_default_channel_layout(codecContext->channels), codecContext->sample_fmt, codecContext->sample_rate,
-                                    0, nullptr);
+    return ret;
+}
 
-    if (!swrContext || swr_init(swrContext) < 0) {
-        LOGE("Failed to initialize the resampling context");
+// Décodage parallèle des longs fichiers: une tranche de temps par thread, d'au moins PARALLEL_DECODE_MIN_PART échantillons
+#define PARALLEL_DECODE_MIN_PART  (60 * TARGET_SAMPLE_RATE)
+// Chaque tranche commence à être décodée PARALLEL_DECODE_SETTLE échantillons avant ce qui est conservé, le temps
+// que le décodeur (réservoir de bits MP3, amorce AAC) et le rééchantillonneur retrouvent le même état qu'en décodage continu
+#define PARALLEL_DECODE_SETTLE    (TARGET_SAMPLE_RATE / 2)
+// Recollage: PARALLEL_DECODE_MATCH échantillons de la fin de la tranche précédente sont recherchés dans la suivante,
+// à PARALLEL_DECODE_SEARCH échantillons près de la position donnée par les timestamps (imprécis après un seek MP3)
+#define PARALLEL_DECODE_MATCH     (TARGET_SAMPLE_RATE / 10)
+#define PARALLEL_DECODE_SEARCH    TARGET_SAMPLE_RATE
+
+// Position dans part où reprend la fin de prev (ses PARALLEL_DECODE_MATCH derniers échantillons), cherchée autour de expected.
+// À erreur égale la position la plus proche de expected l'emporte, ce qui garde les timestamps dans les silences.
+// Renvoie -1 si rien ne correspond.
+static int64_t stitchOffset(const std::vector<float>& prev, const std::vector<float>& part, int64_t expected) {
+    const int n = PARALLEL_DECODE_MATCH;
+    if ((int64_t) prev.size() < n) {
         return -1;
     }
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi initialize the resampling context");
+    const float* tail = prev.data() + prev.size() - n;
+
+    double ref = 0.0;
+    for (int i = 0; i < n; i++) {
+        ref += (double) tail[i]*tail[i];
+    }
+
+    int64_t best = -1;
+    double best_err = INFINITY;
+    for (int d = 0; d <= PARALLEL_DECODE_SEARCH; d++) {
+        for (int sign = 1; sign >= -1; sign -= 2) {
+            const int64_t s = expected + sign*d;
+            if (s < 0 || s + n > (int64_t) part.size() || (d == 0 && sign < 0)) {
+                continue;
+            }
+            const float* cand = part.data() + s;
+            double err = 0.0;
+            for (int i = 0; i < n && err < best_err; i++) {
+                const double e = (double) cand[i] - tail[i];
+                err += e*e;
+            }
+            if (err < best_err) {
+                best_err = err;
+                best = s;
+            }
+        }
+    }
 
-    AVPacket packet;
-    av_init_packet(&packet);
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi av_init_packet");
+    // Au plus -20 dB d'écart, ou du silence des deux côtés (moins de 2 pas d'un int16 d'écart moyen)
+    if (best < 0 || (best_err*100 > ref && best_err > n*(2.0/32768)*(2.0/32768))) {
+        return -1;
+    }
+    return best;
+}
 
-    while (true) {
-        if ((ret = av_read_frame(formatContext, &packet)) < 0)
+// Place source (à défaut inputPath ouvert avec openAudioSource()) avant l'échantillon sample. Si le seek tombe
+// après sample (MP3 en VBR, index imprécis), il est refait plus tôt du dépassement plus PARALLEL_DECODE_SETTLE; si la
+// source ne sait pas se placer, elle est rouverte et lue depuis le début. pos reçoit la position atteinte.
+static std::unique_ptr<AudioSource> openAudioSourceBefore(const char* inputPath, std::unique_ptr<AudioSource> source,
+                                                          int64_t sample, int64_t& pos) {
+    if (!source) {
+        source = openAudioSource(inputPath);
+    }
+    pos = 0;
+    if (!source || sample <= 0) {
+        return source;
+    }
+    int64_t target = sample - PARALLEL_DECODE_SETTLE;
+    for (;;) {
+        if (!source->seek(std::max<int64_t>(0, target))) {
+            pos = 0;
+            return openAudioSource(inputPath);
+        }
+        pos = source->position();
+        if (pos <= sample || target <= 0) {
             break;
-        __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi av_read_frame");
+        }
+        target -= pos - sample + PARALLEL_DECODE_SETTLE;
+    }
+    if (pos > sample) {
+        // Même un seek au début n'a pas suffi
+        pos = 0;
+        return openAudioSource(inputPath);
+    }
+    return source;
+}
 
-        if (packet.stream_index == audioStreamIndex) {
-            ret = avcodec_send_packet(codecContext, &packet);
+// Décode un long fichier seekable par tranches de temps en parallèle, chaque tranche avec sa propre source
+// (openAudioSource: WAV mappé, dr_wav, dr_mp3 ou FFmpeg), puis recolle les tranches à l'échantillon près en
+// alignant le contenu des zones qui se recouvrent.
+// Renvoie false si le fichier ne s'y prête pas (trop court, pas seekable) ou si le recollage échoue.
+static bool decodeAudioParallel(const char* inputPath, std::vector<float>& out, whisper_thread_pool& pool) {
+    // Sonder la durée et la possibilité de se placer dans le fichier, sans seek
+    std::unique_ptr<AudioSource> probe = openAudioSource(inputPath);
+    if (!probe) {
+        return false;
+    }
+    const int64_t n_total = probe->expectedSamples();
+    const bool seekable = probe->seekable();
 
-            if (ret < 0) {
-                LOGE("Error sending a packet for decoding: %s", av_err2str(ret));
-                break;
-            }
-            __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi sending packet for decoding");
+    const int n_parts = (int) std::min<int64_t>(pool.n_threads(), n_total/PARALLEL_DECODE_MIN_PART);
+    if (!seekable || n_parts < 2) {
+        return false;
+    }
 
-            while (ret >= 0) {
-                ret = avcodec_receive_frame(codecContext, frame);
+    // Les sources des tranches sont ouvertes ici, l'une après l'autre: reopen() leur partage ce que la sonde a
+    // construit (la table de seek MP3 n'est calculée qu'une fois). Sinon chaque tranche ouvre la sienne
+    std::vector<std::unique_ptr<AudioSource>> sources(n_parts);
+    for (int k = 0; k < n_parts; k++) {
+        sources[k] = probe->reopen();
+    }
+    probe.reset();
+
+    // La tranche k garde [begin - MATCH - SEARCH, end) en positions annoncées par les timestamps,
+    // la dernière va jusqu'à la fin du fichier
+    const int64_t margin = PARALLEL_DECODE_MATCH + PARALLEL_DECODE_SEARCH;
+    std::vector<std::vector<float>> parts(n_parts);
+    std::vector<int64_t> parts_begin(n_parts);
+    std::vector<char> parts_ok(n_parts, 0);
+
+    pool.parallel_for(n_parts, 1, [&](int k0, int k1, int) {
+        for (int k = k0; k < k1; k++) {
+            const int64_t begin = k == 0 ? 0 : std::max<int64_t>(0, n_total*k/n_parts - margin);
+            const int64_t end   = k + 1 < n_parts ? n_total*(k + 1)/n_parts : INT64_MAX;
+            std::vector<float>& part = parts[k];
+            part.reserve(std::min(end, n_total) - begin + (k + 1 < n_parts ? 0 : TARGET_SAMPLE_RATE));
+            parts_begin[k] = begin;
+
+            // Chaque tranche a sa propre source, placée avant le début de la tranche
+            int64_t pos = 0;
+            std::unique_ptr<AudioSource> source = openAudioSourceBefore(inputPath, std::move(sources[k]), begin, pos);
+            if (!source) {
+                continue;
+            }
 
-                if (ret == AVERROR(EAGAIN)) {
-                    // Le décodeur a besoin de plus de paquets pour générer un frame complet
-                    break;
-                } else if (ret == AVERROR_EOF) {
-                    // Fin de l'encodage, tous les paquets ont été décodés
+            std::vector<float> block(TARGET_SAMPLE_RATE);
+            bool ok = true;
+            while (pos < end) {
+                const int n = source->read(block.data(), block.size());
+                if (n <= 0) {
+                    ok = n == 0 && k + 1 == n_parts;
                     break;
-                } else if (ret < 0) {
-                    LOGE("Error during decoding: %s", av_err2str(ret));
-                    return -1;
                 }
-                __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi decoding");
+                const int64_t i0 = std::max(pos, begin);
+                const int64_t i1 = std::min(pos + n, end);
+                if (i1 > i0) {
+                    part.insert(part.end(), block.begin() + (i0 - pos), block.begin() + (i1 - pos));
+                }
+                pos += n;
+            }
+
+            parts_ok[k] = ok;
+        }
+    });
 
-                convert_frame(swrContext, codecContext, frame, &data, &dataSize, false);
-                __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi convert_frame");
+    // Recollage, d'abord les décalages: la fin de la tranche k-1 est aussi celle du résultat recollé jusque là
+    std::vector<int64_t> offsets(n_parts, 0);
+    int64_t n_out = 0;
+    for (int k = 0; k < n_parts; k++) {
+        if (!parts_ok[k]) {
+            LOGE("Parallel decoding: part %d failed", k);
+            return false;
+        }
+        if (k > 0) {
+            const int64_t expected = n_out - PARALLEL_DECODE_MATCH - parts_begin[k];
+            const int64_t offset = stitchOffset(parts[k - 1], parts[k], expected);
+            if (offset < 0) {
+                LOGE("Parallel decoding: cannot stitch part %d", k);
+                return false;
+            }
+            if (offset != expected) {
+                __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Parallel decoding: part %d shifted by %lld samples",
+                                    k, (long long) (offset - expected));
             }
+            offsets[k] = offset + PARALLEL_DECODE_MATCH;
         }
+        n_out += (int64_t) parts[k].size() - offsets[k];
+    }
 
-        av_packet_unref(&packet);
-        __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi packet_unref");
+    // puis chaque tranche rejoint out et est libérée aussitôt: out reprend le tampon de la tranche 0 et la
+    // réserve ne recopie que celle-ci, le reste de out n'est écrit qu'à mesure que les tranches disparaissent
+    out = std::move(parts[0]);
+    out.reserve(n_out);
+    for (int k = 1; k < n_parts; k++) {
+        out.insert(out.end(), parts[k].begin() + offsets[k], parts[k].end());
+        std::vector<float>().swap(parts[k]);
     }
 
-    convert_frame(swrContext, codecContext, nullptr, &data, &dataSize, true);
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Réussi final convert frame");
+    __android_log_print(ANDROID_LOG_INFO, "Audio Conversion", "Parallel decoding: %d parts, %zu samples", n_parts, out.size());
+    return true;
+}
 
-    fd = open(outputPath, O_RDWR | O_CREAT, 0666);
-    if (fd < 0) {
-        LOGE("Failed to open output file");
-        return -1;
+// Décode et rééchantillonne n'importe quel fichier audio en mono 16 kHz float, directement en mémoire.
+// Le front end lit le float tel quel: pas de passage par l'int16 qui ajouterait un bruit de quantification.
+// Les longs fichiers seekables sont décodés par tranches sur g_whisper_pool.
+static bool decodeAudioFile(const char* inputPath, std::vector<float>& out) {
+    if (decodeAudioParallel(inputPath, out, g_whisper_pool)) {
+        return true;
+    }
+
+    std::unique_ptr<AudioSource> source = openAudioSource(inputPath);
+    if (!source) {
+        return false;
     }
 
-    write_wave_hdr(fd, dataSize * sizeof(int16_t));
-    write(fd, data, dataSize * sizeof(int16_t));
-    AVFormatContext *pFormatCtx = avformat_alloc_context();
-// Ouvrez le fichier audio et récupérez les informations sur le flux
-    if(avformat_open_input(&pFormatCtx, outputPath, NULL, NULL) != 0){
-        // Gérer l'erreur
+    // La durée annoncée par le fichier évite les réallocations successives
+    out.clear();
+    if (source->expectedSamples() > 0) {
+        out.reserve(source->expectedSamples() + TARGET_SAMPLE_RATE);
     }
-    if(avformat_find_stream_info(pFormatCtx, NULL) < 0){
-        // Gérer l'erreur
+    std::vector<float> block(TARGET_SAMPLE_RATE);
+    int n;
+    while ((n = source->read(block.data(), block.size())) > 0) {
+        out.insert(out.end(), block.begin(), block.begin() + n);
     }
+    return n == 0;
+}
 
-// La durée du flux est stockée en microsecondes
-    int64_t duration_us = pFormatCtx->duration;
-// Convertir en secondes
-    double duration_sec = ((double)duration_us) / AV_TIME_BASE;
-    __android_log_print(ANDROID_LOG_VERBOSE, "Audio Conversion", "Durée en sec: %f", duration_sec);
+// Vérifie que le tensor d'entrée de l'interpréteur peut recevoir une fenêtre [n_mel][WHISPER_MEL_LEN]
+static bool checkInputTensor(int n_mel) {
+    int input = g_whisper_tflite_params.interpreter->inputs()[0];
+    const TfLiteTensor* input_tensor = g_whisper_tflite_params.interpreter->tensor(input);
+    if (INFERENCE_ON_AUDIO_FILE && input_tensor->bytes != n_mel * WHISPER_MEL_LEN * sizeof(float)) {
+        __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "Taille du tensor d'entrée inattendue: %zu octets pour %d x %d",
+                            input_tensor->bytes, n_mel, WHISPER_MEL_LEN);
+        return false;
+    }
+    return true;
+}
 
-    close(fd);
-    avformat_close_input(&pFormatCtx);
-    free(data);
-    swr_free(&swrContext);
-    av_frame_free(&frame);
-    avcodec_free_context(&codecContext);
-    avformat_close_input(&formatContext);
+// Exécute l'encodeur sur la fenêtre déjà écrite dans le tensor d'entrée et ajoute les tokens décodés à text
+static void invokeWhisper(std::string& text) {
+    // Exécuter l'inférence
+    if (g_whisper_tflite_params.interpreter->Invoke() != kTfLiteOk) fprintf(stderr, "%s: failed to execute inference\n", __func__);;
 
-    env->ReleaseStringUTFChars(inputFilePath, inputPath);
-    env->ReleaseStringUTFChars(outputFilePath, outputPath);
+    // Traiter le résultat
+    int output = g_whisper_tflite_params.interpreter->outputs()[0];
+    TfLiteTensor *output_tensor = g_whisper_tflite_params.interpreter->tensor(output);
+    TfLiteIntArray *output_dims = output_tensor->dims;
+    auto output_size = output_dims->data[output_dims->size - 1];
+    int *output_int = g_whisper_tflite_params.interpreter->typed_output_tensor<int>(0);
 
-    return 0;
+    for (int j = 0; j < output_size; j++) {
+        if(output_int[j] == g_vocab.token_eot){
+            break;
+        }
+        if((output_int[j] !=50257) && (output_int[j] !=50362) && (output_int[j] !=50265) && (output_int[j] !=50258) && (output_int[j] !=50359))
+            text += whisper_token_to_str(output_int[j]);
+    }
 }
 
-std::string runTranscription(std::vector<std::vector<float>>& segments, size_t segment_size, std::function<void(int)> callback) {
+std::string runTranscription(const whisper_mel& mel, const std::vector<whisper_window>& windows, std::function<void(int)> callback) {
     std::string text = "";
-    for (size_t i = 0; i < segments.size(); ++i) {
-        const auto processor_count = std::thread::hardware_concurrency();
-        auto& segment = segments[i];  // Obtenir le segment courant
-        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Taille de segment: %d", segment.size());
-
-        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Stade: %d", i);
-        // Calculez la taille de la tranche actuelle. Si nous sommes à la fin des données, elle pourrait être plus petite que `chunk_size`.
-        int current_chunk_size = std::min(segment_size, segment.size());
-        if (current_chunk_size < segment_size) {
-            __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "On y est");
-            // Si la tranche est plus petite que `chunk_size`, ajoutez des zéros pour l'aligner à `chunk_size`.
-            segment.insert(segment.end(), WHISPER_SAMPLE_RATE*WHISPER_CHUNK_SIZE - segment.size(), 0);
-        }
+    const int n_windows = windows.size();
 
-        // Remplacer pcmf32.data() par segment.data() pour log_mel_spectrogram
-        if (!log_mel_spectrogram(segment.data(), segment.size(), WHISPER_SAMPLE_RATE, WHISPER_N_FFT, WHISPER_HOP_LENGTH, WHISPER_N_MEL, processor_count,filters, mel)) {
-            fprintf(stderr, "%s: failed to compute mel spectrogram\n", __func__);
-            //return result;
-        }
+    // Les fenêtres sont écrites directement dans le tensor d'entrée de l'interpréteur
+    if (!checkInputTensor(mel.n_mel)) {
+        return text;
+    }
 
-        // Copier un segment de données dans le tensor d'entrée
+    for (int i = 0; i < n_windows; ++i) {
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Stade: %d", i);
+        // La fenêtre i juxtapose des plages de trames du spectrogramme complet,
+        // la fin de la fenêtre est remplie comme l'aurait été un signal nul.
         if (INFERENCE_ON_AUDIO_FILE) {
-            __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Essai de copie dans le buffer: %d", mel.data.data());
-            __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Taille de mel data: %d", mel.data.size());
-
-            memcpy(g_whisper_tflite_params.input, mel.data.data(), WHISPER_N_MEL * WHISPER_MEL_LEN * sizeof(float));
-            __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Copie réussie");
+            whisper_mel_get_window(mel, windows[i], g_whisper_tflite_params.input);
         } else {
-            // Remarque: cette partie du code pourrait nécessiter une modification similaire
             memcpy(g_whisper_tflite_params.input, _content_input_features_bin, WHISPER_N_MEL*WHISPER_MEL_LEN*sizeof(float));
         }
+        for (const auto& seg : windows[i].segments) {
+            __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR", "Fenêtre %d: %.2f s - %.2f s", i,
+                                (float) seg.offset*WHISPER_HOP_LENGTH/WHISPER_SAMPLE_RATE,
+                                (float) (seg.offset + seg.n_len)*WHISPER_HOP_LENGTH/WHISPER_SAMPLE_RATE);
+        }
 
-        // Exécuter l'inférence
-        if (g_whisper_tflite_params.interpreter->Invoke() != kTfLiteOk) fprintf(stderr, "%s: failed to execute inference\n", __func__);;
-
-        // Traiter le résultat
-        int output = g_whisper_tflite_params.interpreter->outputs()[0];
-        TfLiteTensor *output_tensor = g_whisper_tflite_params.interpreter->tensor(output);
-        TfLiteIntArray *output_dims = output_tensor->dims;
-        auto output_size = output_dims->data[output_dims->size - 1];
-        int *output_int = g_whisper_tflite_params.interpreter->typed_output_tensor<int>(0);
+        invokeWhisper(text);
 
-        for (int j = 0; j < output_size; j++) {
-            if(output_int[j] == g_vocab.token_eot){
-                break;
-            }
-            if((output_int[j] !=50257) && (output_int[j] !=50362) && (output_int[j] !=50265) && (output_int[j] !=50258) && (output_int[j] !=50359))
-                text += whisper_token_to_str(output_int[j]);
-        }
         // Calculate progress percentage
-        int progress = static_cast<int>((static_cast<double>(i + 1) / segments.size()) * 100);
-        __android_log_print(ANDROID_LOG_VERBOSE, "Progression", "\n%d\n", segment_size);
+        int progress = static_cast<int>((static_cast<double>(i + 1) / n_windows) * 100);
+        __android_log_print(ANDROID_LOG_VERBOSE, "Progression", "\n%d\n", progress);
         __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR: part transcript", "\n%s\n", text.c_str());
         // Après chaque itération, appelez la fonction de rappel pour envoyer la transcription partielle
         callback(progress);
@@ -477,20 +793,9 @@ std::string runTranscription(std::vector<std::vector<float>>& segments, size_t s
 // Example: load a tflite model using TF Lite C++ API
 // Credit to https://github.com/ValYouW/crossplatform-tflite-object-detecion
 // Credit to https://github.com/cuongvng/TF-Lite-Cpp-API-for-Android
-extern "C" JNIEXPORT jstring JNICALL
-Java_com_example_audio2text_MyApplication_loadModelJNI(
-        JNIEnv* env,
-        jobject /* this */,
-        jobject assetManager,
-        jstring fileName,
-        jobject callback) {
-
-    // Get the ProgressCallback class and its onProgress method
-    jclass CallbackClass = env->GetObjectClass(callback);
-    jmethodID CallbackMethod = env->GetMethodID(CallbackClass, "onProgressUpdate", "(I)V");
-
+// Charge le modèle, les filtres et le vocabulaire, puis construit l'interpréteur, une seule fois
+static bool loadModel(JNIEnv* env, jobject assetManager) {
     //Load Whisper Model into buffer
-    jstring result = NULL;
     struct timeval start_time,end_time;
     if(!g_whisper_tflite_params.is_whisper_tflite_initialized) {
         gettimeofday(&start_time, NULL);
@@ -523,7 +828,7 @@ Java_com_example_audio2text_MyApplication_loadModelJNI(
                 __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR",
                                     "%s: invalid vocab file '%s' (bad magic)\n", __func__,
                                     vocab_filename);
-                return result;
+                return false;
             }
             // load mel filters
             {
@@ -533,6 +838,10 @@ Java_com_example_audio2text_MyApplication_loadModelJNI(
                                     __func__, filters.n_mel, filters.n_fft);
                 filters.data.resize(filters.n_mel * filters.n_fft);
                 AAsset_read(asset, (char *) filters.data.data(), filters.data.size() * sizeof(float));
+
+                whisper_filters_build_bands(filters);
+                __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR", "%s: mel filter bands: %zu weights\n",
+                                    __func__, filters.band_data.size());
             }
 
             int32_t n_vocab = 0;
@@ -593,91 +902,9 @@ Java_com_example_audio2text_MyApplication_loadModelJNI(
         __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR",
                             "JNI mel filter extraction time %ld seconds \n",
                             (end_time.tv_sec - start_time.tv_sec));
-}
-    gettimeofday(&start_time, NULL);
-    // WAV input
-    std::vector<float> pcmf32;
-    std::vector<std::vector<float>> segments;  // vecteur pour stocker les segments
-    size_t segment_size = WHISPER_SAMPLE_RATE*WHISPER_CHUNK_SIZE;
-    //Generate input_features for Audio file
-    if (INFERENCE_ON_AUDIO_FILE) {
-        const char* pcmfilename = env->GetStringUTFChars(fileName, 0);
-        __android_log_print(ANDROID_LOG_VERBOSE, "Filename", "Le fichier est : %s", pcmfilename);
-        {
-            drwav wav;
-            //drmp3 mp3;
-
-            // Open the file in binary mode
-            std::ifstream file(pcmfilename, std::ios::binary);
-
-            // Read the file into a vector
-            std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-
-            // Now buffer contains the file data. If you need a char *, you can get it like this:
-            char *wav_buffer = &buffer[0];
-
-            if (!drwav_init_memory(&wav, wav_buffer, buffer.size(),NULL)) {
-             __android_log_print(ANDROID_LOG_VERBOSE, "Niranjan", "failed to open WAV file '%s' - check your input\n", pcmfilename);
-             return result;
-          }
-            if (wav.channels != 1 && wav.channels != 2) {
-                __android_log_print(ANDROID_LOG_VERBOSE, "Niranjan", "WAV file '%s' must be mono or stereo\n", pcmfilename);
-
-                return result;
-            }
-
-            if (wav.sampleRate != WHISPER_SAMPLE_RATE) {
-                __android_log_print(ANDROID_LOG_VERBOSE, "Niranjan", "WWAV file '%s' must be 16 kHz\n", pcmfilename);
-                return result;
-            }
-
-            if (wav.bitsPerSample != 16) {
-                __android_log_print(ANDROID_LOG_VERBOSE, "Niranjan", "WAV file '%s' must be 16-bit\n", pcmfilename);
-                return result;
-            }
-
-            int n = wav.totalPCMFrameCount;
-
-            __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Nombre de frames: %d", n);
-
-            std::vector<int16_t> pcm16;
-            pcm16.resize(n*wav.channels);
-            drwav_read_pcm_frames_s16(&wav, n, pcm16.data());
-            drwav_uninit(&wav);
-            // convert to mono, float
-            pcmf32.resize(n);
-            if (wav.channels == 1) {
-                for (int i = 0; i < n; i++) {
-                    pcmf32[i] = float(pcm16[i])/32768.0f;
-                }
-            } else {
-                for (int i = 0; i < n; i++) {
-                    pcmf32[i] = float(pcm16[2*i] + pcm16[2*i + 1])/65536.0f;
-                }
-            }
-
-            double duration_in_seconds = (double)n / wav.sampleRate;
-            __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR:", "Audio duration: %f seconds", duration_in_seconds);
-        }
-
-        env->ReleaseStringUTFChars(fileName, pcmfilename);
-    }//end of audio file processing
-
-    for (size_t i = 0; i < pcmf32.size(); i += segment_size) {
-        size_t end = i + segment_size;
-        if (end > pcmf32.size()) {
-            end = pcmf32.size();
-        }
-
-        std::vector<float> segment(pcmf32.begin() + i, pcmf32.begin() + end);
-        segments.push_back(segment);
     }
 
-    gettimeofday(&end_time, NULL);
-    __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR", "JNI (Spectrogram)input feature extraction time %ld seconds \n",(end_time.tv_sec-start_time.tv_sec));
-
     if(!g_whisper_tflite_params.is_whisper_tflite_initialized) {
-        __android_log_print(ANDROID_LOG_INFO, "MyApp", "On y est!!!!!!!!!!!");
         // Load tflite model buffer
         g_whisper_tflite_params.model =
                 tflite::FlatBufferModel::BuildFromBuffer(g_whisper_tflite_params.buffer, g_whisper_tflite_params.size);
@@ -711,20 +938,79 @@ Java_com_example_audio2text_MyApplication_loadModelJNI(
         __android_log_print(ANDROID_LOG_ERROR, "MyApp", "Failed to initialize interpreter");
     }
 
+    return g_whisper_tflite_params.interpreter != nullptr;
+}
+
+// Transcrit un signal 16 kHz déjà en mémoire: spectrogramme (ou cache), VAD puis encodeur
+static jstring transcribePcm(JNIEnv* env, const whisper_pcm& pcm, jstring cacheDir, jobject callback) {
+    // Get the ProgressCallback class and its onProgress method
+    jclass CallbackClass = env->GetObjectClass(callback);
+    jmethodID CallbackMethod = env->GetMethodID(CallbackClass, "onProgressUpdate", "(I)V");
+
+    jstring result = NULL;
+    struct timeval start_time,end_time;
     gettimeofday(&start_time, NULL);
-    std::string text = "";
-    int total_segments = pcmf32.size(); // Nombre total de segments
-    __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Le nombre de segments est : %d", total_segments);
 
-    int input = g_whisper_tflite_params.interpreter->inputs()[0];
-    TfLiteTensor* input_tensor = g_whisper_tflite_params.interpreter->tensor(input);
-    TfLiteIntArray* dims = input_tensor->dims;
-    int tensor_size = 1;
-    for (int i = 0; i < dims->size; ++i) {
-        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Dimension %d: %d", i, dims->data[i]);
+    // Cache optionnel des spectrogrammes, indexé par le contenu audio et les paramètres du front end
+    std::string cache_dir;
+    std::string cache_path;
+    uint64_t cache_key = 0;
+    if (cacheDir != nullptr && INFERENCE_ON_AUDIO_FILE) {
+        const char* dir = env->GetStringUTFChars(cacheDir, nullptr);
+        cache_dir = dir;
+        env->ReleaseStringUTFChars(cacheDir, dir);
+    }
+    if (!cache_dir.empty()) {
+        cache_key  = whisper_mel_cache_key(pcm, WHISPER_N_FFT, WHISPER_HOP_LENGTH, filters);
+        cache_path = whisper_mel_cache_path(cache_dir, cache_key);
+    }
+
+    if (!cache_path.empty() && whisper_mel_cache_load(cache_path, cache_key, mel)) {
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Spectrogramme trouvé dans le cache: %s", cache_path.c_str());
+    } else {
+        // Un seul spectrogramme pour tout le fichier, découpé ensuite en fenêtres de WHISPER_MEL_LEN trames
+        if (!log_mel_spectrogram(pcm, WHISPER_SAMPLE_RATE, WHISPER_N_FFT, WHISPER_HOP_LENGTH, filters.n_mel, g_whisper_pool, filters, mel)) {
+            __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "%s: failed to compute mel spectrogram\n", __func__);
+            return result;
+        }
+
+        if (!cache_path.empty()) {
+            if (whisper_mel_cache_store(cache_path, cache_key, mel)) {
+                whisper_mel_cache_trim(cache_dir, WHISPER_MEL_CACHE_MAX_ENTRIES);
+            } else {
+                __android_log_print(ANDROID_LOG_WARN, "Whisper ASR", "Impossible d'écrire le cache %s", cache_path.c_str());
+            }
+        }
+    }
+
+    gettimeofday(&end_time, NULL);
+    __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR", "JNI (Spectrogram)input feature extraction time %ld seconds \n",(end_time.tv_sec-start_time.tv_sec));
+
+    gettimeofday(&start_time, NULL);
+    std::string text = "";
+    // Détection d'activité vocale: seules les zones de parole sont regroupées dans les fenêtres de l'encodeur.
+    // Les fenêtres ne sont que des plages de trames, aucune copie de l'audio.
+    std::vector<whisper_window> windows;
+    {
+        whisper_vad vad;
+        whisper_vad_detect(pcm, whisper_vad_params(), g_whisper_pool, vad);
+        whisper_vad_pack(vad, mel, whisper_pack_params(), windows);
+
+        const int n_fixed = whisper_mel_n_windows(mel);
+        const int n_total = windows.size();
+        const float speech_s = (float) vad.n_speech()*vad.frame_len/WHISPER_SAMPLE_RATE;
+        const float total_s  = (float) pcm.n_samples/WHISPER_SAMPLE_RATE;
+
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "VAD: seuil %.1f dBFS, parole %.1f s sur %.1f s",
+                            vad.thold, speech_s, total_s);
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "VAD: %d fenêtres au lieu de %d (%.0f%% d'inférence évitée)",
+                            n_total, n_fixed, n_fixed > 0 ? 100.0f*(n_fixed - n_total)/n_fixed : 0.0f);
     }
 
-    std::string transcription = runTranscription(segments, segment_size, [env, callback, CallbackMethod](int progress) {
+    int total_segments = windows.size(); // Nombre total de segments
+    __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Le nombre de segments est : %d", total_segments);
+
+    std::string transcription = runTranscription(mel, windows, [env, callback, CallbackMethod](int progress) {
             env->CallVoidMethod(callback, CallbackMethod, progress);
             __android_log_print(ANDROID_LOG_INFO, "MyApp", "Progress: %d", progress);
     });
@@ -732,4 +1018,351 @@ Java_com_example_audio2text_MyApplication_loadModelJNI(
     //std::string status = "Load TF Lite model successfully!";
         //free(buffer);
     return env->NewStringUTF(transcription.c_str());
-    }
\ No newline at end of file
+    }
+
+// Profondeur des files entre les étages du pipeline
+#define PIPELINE_PCM_BLOCK   TARGET_SAMPLE_RATE   // échantillons par bloc décodé (1 s)
+#define PIPELINE_PCM_QUEUE   8                    // blocs décodés d'avance sur le spectrogramme
+#define PIPELINE_N_WINDOWS   3                    // fenêtres [n_mel][WHISPER_MEL_LEN] allouées au total
+
+// Fenêtre de l'encodeur produite par l'étage spectrogramme
+struct pipeline_window {
+    int index = 0;
+    int n_len = 0;        // trames réelles, le reste de la fenêtre est du remplissage
+    bool speech = true;   // faux si la VAD n'a trouvé aucune parole dans la fenêtre
+    std::vector<float> data;
+};
+
+// Transcription en pipeline: lecture ou décodage de l'audio, spectrogramme et encodeur tournent en parallèle,
+// reliés par des files bornées. Le spectrogramme de la fenêtre N+1 est calculé pendant l'Invoke() de la fenêtre N,
+// la durée totale tend vers celle de l'étage le plus lent au lieu de la somme des étages.
+// Chaque fenêtre est normalisée par le maximum glissant du flux (le maximum du fichier entier n'est connu qu'à la fin),
+// le mel peut donc différer de celui de transcribePcm sur les premières fenêtres. Les fenêtres sans parole sont sautées;
+// il n'y a ni cache ni regroupement des zones de parole entre fenêtres, voir transcribePcm pour cela.
+// Chemin optionnel côté Kotlin (TranscriptionWorker.KEY_STREAMING), transcribeFileJNI reste le chemin par défaut.
+static jstring transcribePipelined(JNIEnv* env, AudioSource& source, jobject callback) {
+    jstring result = NULL;
+
+    if (!checkInputTensor(filters.n_mel)) {
+        return result;
+    }
+
+    jclass CallbackClass = env->GetObjectClass(callback);
+    jmethodID CallbackMethod = env->GetMethodID(CallbackClass, "onProgressUpdate", "(I)V");
+
+    struct timeval start_time,end_time;
+    gettimeofday(&start_time, NULL);
+
+    const int n_mel = filters.n_mel;
+    const int window_samples = WHISPER_MEL_LEN*WHISPER_HOP_LENGTH;
+
+    // Les fenêtres circulent entre free_windows et window_queue: jamais plus de PIPELINE_N_WINDOWS en mémoire
+    whisper_queue<std::vector<float>> pcm_queue(PIPELINE_PCM_QUEUE);
+    whisper_queue<pipeline_window> window_queue(PIPELINE_N_WINDOWS);
+    whisper_queue<std::vector<float>> free_windows(PIPELINE_N_WINDOWS);
+    for (int i = 0; i < PIPELINE_N_WINDOWS; i++) {
+        free_windows.push(std::vector<float>(n_mel*WHISPER_MEL_LEN));
+    }
+
+    const int64_t n_expected = source.expectedSamples();
+    bool decode_ok = false;
+
+    // Étage 1: lecture ou décodage de l'audio en blocs de PIPELINE_PCM_BLOCK échantillons
+    std::thread decoder([&]() {
+        while (true) {
+            std::vector<float> block(PIPELINE_PCM_BLOCK);
+            const int n = source.read(block.data(), PIPELINE_PCM_BLOCK);
+            if (n <= 0) {
+                decode_ok = n == 0;
+                break;
+            }
+            block.resize(n);
+            if (!pcm_queue.push(std::move(block))) {
+                break;
+            }
+        }
+        pcm_queue.close();
+    });
+
+    // Étage 2: spectrogramme en continu, transposé directement dans les fenêtres de l'encodeur
+    std::thread spectrogram([&]() {
+        whisper_mel_stream stream(filters, WHISPER_N_FFT, WHISPER_HOP_LENGTH, WHISPER_MEL_LEN);
+        std::vector<float> frames;
+        std::vector<float> window_pcm; // audio de la fenêtre en cours, pour la VAD
+        window_pcm.reserve(window_samples + PIPELINE_PCM_BLOCK);
+
+        pipeline_window window;
+        bool ok = free_windows.pop(window.data);
+
+        // Termine la fenêtre en cours (remplissage compris) et la passe à l'encodeur
+        auto finish = [&]() {
+            const float pad = stream.pad_value();
+            for (int j = 0; j < n_mel; j++) {
+                std::fill(window.data.begin() + j*WHISPER_MEL_LEN + window.n_len,
+                          window.data.begin() + (j + 1)*WHISPER_MEL_LEN, pad);
+            }
+
+            const int n_pcm = std::min<int>(window_pcm.size(), window_samples);
+            whisper_vad vad;
+            whisper_vad_detect(whisper_pcm_f32(window_pcm.data(), n_pcm), whisper_vad_params(), g_whisper_pool, vad);
+            window.speech = vad.n_speech() > 0;
+            window_pcm.erase(window_pcm.begin(), window_pcm.begin() + n_pcm);
+
+            const int index = window.index;
+            if (!window_queue.push(std::move(window))) {
+                return false;
+            }
+            window = pipeline_window();
+            window.index = index + 1;
+            return free_windows.pop(window.data);
+        };
+
+        // Range les nouvelles trames (frame-major) dans la fenêtre [n_mel][WHISPER_MEL_LEN]
+        auto store = [&]() {
+            const int n_frames = frames.size()/n_mel;
+            for (int i = 0; ok && i < n_frames; i++) {
+                const float* frame = frames.data() + i*n_mel;
+                float* dst = window.data.data() + window.n_len;
+                for (int j = 0; j < n_mel; j++) {
+                    dst[j*WHISPER_MEL_LEN] = frame[j];
+                }
+                if (++window.n_len == WHISPER_MEL_LEN) {
+                    ok = finish();
+                }
+            }
+            frames.clear();
+        };
+
+        std::vector<float> block;
+        while (ok && pcm_queue.pop(block)) {
+            window_pcm.insert(window_pcm.end(), block.begin(), block.end());
+            stream.push(block.data(), block.size(), frames);
+            store();
+        }
+        if (ok) {
+            stream.flush(frames);
+            store();
+        }
+        if (ok && window.n_len > 0) {
+            finish();
+        }
+
+        // En cas d'arrêt anticipé, le décodeur ne doit pas rester bloqué sur une file pleine
+        pcm_queue.close();
+        window_queue.close();
+    });
+
+    // Étage 3: l'encodeur, sur ce thread qui détient le JNIEnv pour les rappels de progression
+    std::string text = "";
+    pipeline_window window;
+    int n_skipped = 0;
+    while (window_queue.pop(window)) {
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Stade: %d (%.2f s - %.2f s)%s", window.index,
+                            (float) window.index*window_samples/WHISPER_SAMPLE_RATE,
+                            (float) (window.index*WHISPER_MEL_LEN + window.n_len)*WHISPER_HOP_LENGTH/WHISPER_SAMPLE_RATE,
+                            window.speech ? "" : ", pas de parole");
+
+        // Le tensor d'entrée est occupé pendant Invoke(): la fenêtre y est copiée puis rendue
+        // tout de suite à l'étage spectrogramme, qui prépare la suivante pendant l'inférence
+        if (window.speech) {
+            memcpy(g_whisper_tflite_params.input, window.data.data(), n_mel*WHISPER_MEL_LEN*sizeof(float));
+        } else {
+            n_skipped++;
+        }
+        free_windows.push(std::move(window.data));
+
+        if (window.speech) {
+            invokeWhisper(text);
+            __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR: part transcript", "\n%s\n", text.c_str());
+        }
+
+        // Progression d'après la durée annoncée par le conteneur, 100% seulement à la fin
+        const int64_t n_windows = (n_expected + window_samples - 1)/window_samples;
+        const int progress = n_windows > 0 ? std::min<int>(99, 100*(window.index + 1)/n_windows) : 0;
+        env->CallVoidMethod(callback, CallbackMethod, progress);
+    }
+
+    free_windows.close();
+    decoder.join();
+    spectrogram.join();
+
+    gettimeofday(&end_time, NULL);
+    if (!decode_ok) {
+        __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "%s: failed to read audio\n", __func__);
+        return result;
+    }
+    __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Pipeline: %d fenêtres sans parole sautées, %ld ms au total", n_skipped,
+                        (end_time.tv_sec - start_time.tv_sec)*1000 + (end_time.tv_usec - start_time.tv_usec)/1000);
+
+    env->CallVoidMethod(callback, CallbackMethod, 100);
+    return env->NewStringUTF(text.c_str());
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_loadModelJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jobject assetManager,
+        jstring fileName,
+        jstring cacheDir,
+        jobject callback) {
+    jstring result = NULL;
+
+    if (!loadModel(env, assetManager)) {
+        return result;
+    }
+
+    // WAV input, mapped instead of read: int16 scaling and downmix happen while the frames are windowed
+    // and float WAV files (see convertTo16kHz) are used as is, nothing is copied
+    // Any other rate, channel count or int24/int32 samples go through whisper_downmix() and
+    // whisper_resampler, in memory, never through convertTo16kHz
+    whisper_wav_map wav;
+    std::vector<float> resampled;
+    whisper_pcm pcm;
+    //Generate input_features for Audio file
+    if (INFERENCE_ON_AUDIO_FILE) {
+        const char* pcmfilename = env->GetStringUTFChars(fileName, 0);
+        __android_log_print(ANDROID_LOG_VERBOSE, "Filename", "Le fichier est : %s", pcmfilename);
+        const bool ok = whisper_wav_map_open(pcmfilename, wav);
+        if (!ok) {
+            __android_log_print(ANDROID_LOG_VERBOSE, "Niranjan", "WAV file '%s' must be 16/24/32-bit PCM or 32-bit float\n", pcmfilename);
+        }
+        env->ReleaseStringUTFChars(fileName, pcmfilename);
+        if (!ok) {
+            return result;
+        }
+
+        __android_log_print(ANDROID_LOG_INFO, "Whisper ASR", "Nombre de frames: %lld (%d Hz, %d canaux)",
+                            (long long) wav.n_frames, wav.sample_rate, wav.n_channels);
+        __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR:", "Audio duration: %f seconds", (double) wav.n_frames/wav.sample_rate);
+
+        if (whisper_wav_map_direct(wav)) {
+            pcm = wav.pcm;
+        } else {
+            // transcribePcm et le cache des features travaillent sur le signal 16 kHz complet: rééchantillonner tout le fichier
+            std::unique_ptr<AudioSource> source = WavAudioSource::open(wav);
+            if (!source) {
+                return result;
+            }
+            resampled.reserve(std::max<int64_t>(0, source->expectedSamples()));
+            std::vector<float> block(TARGET_SAMPLE_RATE);
+            int n;
+            while ((n = source->read(block.data(), block.size())) > 0) {
+                resampled.insert(resampled.end(), block.begin(), block.begin() + n);
+            }
+            if (n < 0) {
+                return result;
+            }
+            pcm = whisper_pcm_f32(resampled.data(), resampled.size());
+        }
+    }//end of audio file processing
+
+    return transcribePcm(env, pcm, cacheDir, callback);
+}
+
+// Décode, rééchantillonne et transcrit n'importe quel fichier audio sans passer par un WAV intermédiaire
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_transcribeFileJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jobject assetManager,
+        jstring inputFilePath,
+        jstring cacheDir,
+        jobject callback) {
+    jstring result = NULL;
+
+    if (!loadModel(env, assetManager)) {
+        return result;
+    }
+
+    struct timeval start_time,end_time;
+    gettimeofday(&start_time, NULL);
+
+    const char* inputPath = env->GetStringUTFChars(inputFilePath, nullptr);
+    __android_log_print(ANDROID_LOG_VERBOSE, "Filename", "Le fichier est : %s", inputPath);
+
+    std::vector<float> pcmf32;
+    const bool ok = decodeAudioFile(inputPath, pcmf32);
+    env->ReleaseStringUTFChars(inputFilePath, inputPath);
+
+    gettimeofday(&end_time, NULL);
+    if (!ok) {
+        __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "%s: failed to decode audio file\n", __func__);
+        return result;
+    }
+    __android_log_print(ANDROID_LOG_VERBOSE, "Whisper ASR", "Audio duration: %f seconds, decoded in %ld ms",
+                        (double) pcmf32.size()/WHISPER_SAMPLE_RATE,
+                        (end_time.tv_sec - start_time.tv_sec)*1000 + (end_time.tv_usec - start_time.tv_usec)/1000);
+
+    return transcribePcm(env, whisper_pcm_f32(pcmf32.data(), pcmf32.size()), cacheDir, callback);
+}
+
+// Décode et transcrit n'importe quel fichier audio en pipeline, voir transcribePipelined.
+// Le décodeur est choisi par openAudioSource: les WAV 16 kHz sont lus directement dans le fichier mappé.
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_transcribeStreamJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jobject assetManager,
+        jstring inputFilePath,
+        jobject callback) {
+    jstring result = NULL;
+
+    if (!loadModel(env, assetManager)) {
+        return result;
+    }
+
+    const char* path = env->GetStringUTFChars(inputFilePath, nullptr);
+    const std::string inputPath = path;
+    env->ReleaseStringUTFChars(inputFilePath, path);
+    __android_log_print(ANDROID_LOG_VERBOSE, "Filename", "Le fichier est : %s", inputPath.c_str());
+
+    std::unique_ptr<AudioSource> source = openAudioSource(inputPath);
+    if (!source) {
+        __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "%s: failed to open audio file\n", __func__);
+        return result;
+    }
+
+    return transcribePipelined(env, *source, callback);
+}
+
+// Transcrit seulement l'extrait [startMs, endMs) du fichier (endMs < 0: jusqu'à la fin). La source se
+// place directement près de startMs au lieu de tout décoder depuis le début, et seules les fenêtres de
+// l'encodeur qui couvrent l'extrait sont calculées, voir RangeAudioSource et transcribePipelined.
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_example_audio2text_MyApplication_transcribeRangeJNI(
+        JNIEnv* env,
+        jobject /* this */,
+        jobject assetManager,
+        jstring inputFilePath,
+        jlong startMs,
+        jlong endMs,
+        jobject callback) {
+    jstring result = NULL;
+
+    if (startMs < 0 || (endMs >= 0 && endMs <= startMs)) {
+        __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "%s: invalid range [%lld, %lld) ms\n", __func__,
+                            (long long) startMs, (long long) endMs);
+        return result;
+    }
+
+    if (!loadModel(env, assetManager)) {
+        return result;
+    }
+
+    const char* path = env->GetStringUTFChars(inputFilePath, nullptr);
+    const std::string inputPath = path;
+    env->ReleaseStringUTFChars(inputFilePath, path);
+    __android_log_print(ANDROID_LOG_VERBOSE, "Filename", "Le fichier est : %s, extrait [%lld, %lld) ms", inputPath.c_str(),
+                        (long long) startMs, (long long) endMs);
+
+    const int64_t start = (int64_t) startMs*WHISPER_SAMPLE_RATE/1000;
+    const int64_t end   = endMs < 0 ? INT64_MAX : (int64_t) endMs*WHISPER_SAMPLE_RATE/1000;
+    std::unique_ptr<AudioSource> source = RangeAudioSource::open(openAudioSource(inputPath), start, end);
+    if (!source) {
+        __android_log_print(ANDROID_LOG_ERROR, "Whisper ASR", "%s: failed to open or seek audio file\n", __func__);
+        return result;
+    }
+
+    return transcribePipelined(env, *source, callback);
+}
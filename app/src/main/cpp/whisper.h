@@ -1,8 +1,40 @@
 //Courtesy from @ggerganov https://github.com/ggerganov/whisper.cpp
+#pragma once
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <map>
+#include <memory>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <complex>
 #include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+extern "C" {
+#include <libavutil/tx.h>
+}
+#include <unsupported/Eigen/FFT>
+#include "farmhash.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 #define DR_WAV_IMPLEMENTATION
 #include "dr_wav.h"
@@ -71,20 +103,40 @@ struct whisper_filters {
     int32_t n_fft;
 
     std::vector<float> data;
+
+    // banded copy of data, see whisper_filters_build_bands()
+    // filter j covers bins [band_start[j], band_start[j] + band_len[j])
+    // with weights at band_data[band_offset[j]], band_len[j] is a multiple of 4
+    std::vector<int32_t> band_start;
+    std::vector<int32_t> band_len;
+    std::vector<int32_t> band_offset;
+    std::vector<float>   band_data;
 };
 
+// frame-major: frame i is data[i*n_mel, (i + 1)*n_mel)
+// raw log10 energies, computed once for the whole file, encoder windows are
+// clamped and normalized views into it (whisper_mel_get_window)
 struct whisper_mel {
     int n_len;
     int n_mel;
 
+    float mmax = -1e20f; // largest log10 value before clamping
+
     std::vector<float> data;
+
+    // set instead of data when the frames come from the on-disk cache
+    std::shared_ptr<const float> mapped;
+
+    const float * frames() const {
+        return mapped ? mapped.get() : data.data();
+    }
 };
 whisper_filters filters;
 whisper_mel mel;
 void print(std::vector <float> const &a) {
     std::cout << "The vector elements are : ";
 
-    for(int i=0; i < a.size(); i++)
+    for(size_t i=0; i < a.size(); i++)
         std::cout << a.at(i) << ' ';
 }
 
@@ -92,194 +144,2434 @@ const char * whisper_token_to_str(int token) {
     return g_vocab.id_to_token.at(token).c_str();
 }
 
-// naive Discrete Fourier Transform
-// input is real-valued
-// output is complex-valued
-void dft(const std::vector<float> & in, std::vector<float> & out) {
-    int N = in.size();
+// planned mixed-radix FFT
+// radix 2, 3, 4 and 5 butterflies with a generic fallback for other primes
+// twiddles are computed once per size, whisper_fft_forward() never allocates
+// real input of even size is packed into a complex FFT of half the size
+struct whisper_cpx {
+    float r;
+    float i;
+};
+
+struct whisper_fft_plan {
+    int n     = 0; // real input size
+    int n_cpx = 0; // size of the underlying complex transform
+
+    bool packed = false; // even n: two real samples per complex input
+
+    int max_radix = 0;
+
+    std::vector<int> factors; // (radix, remaining length) pairs
+
+    std::vector<whisper_cpx> twiddles;       // exp(-2*pi*i*k/n_cpx)
+    std::vector<whisper_cpx> super_twiddles; // post-processing of the packed transform
+
+    // number of floats the caller must provide as scratch to whisper_fft_forward()
+    int n_scratch() const {
+        return 2*(2*n_cpx + max_radix);
+    }
+};
+
+static inline whisper_cpx whisper_cpx_mul(const whisper_cpx & a, const whisper_cpx & b) {
+    return { a.r*b.r - a.i*b.i, a.r*b.i + a.i*b.r };
+}
+
+bool whisper_fft_plan_init(whisper_fft_plan & plan, int n) {
+    if (n < 1) {
+        return false;
+    }
+
+    plan.n      = n;
+    plan.packed = n%2 == 0 && n > 2;
+    plan.n_cpx  = plan.packed ? n/2 : n;
 
-    out.resize(N*2);
+    plan.twiddles.resize(plan.n_cpx);
+    for (int k = 0; k < plan.n_cpx; k++) {
+        const double phase = -2.0*M_PI*k/plan.n_cpx;
+        plan.twiddles[k] = { (float) cos(phase), (float) sin(phase) };
+    }
 
-    for (int k = 0; k < N; k++) {
-        float re = 0;
-        float im = 0;
+    plan.super_twiddles.clear();
+    if (plan.packed) {
+        plan.super_twiddles.resize(plan.n_cpx/2);
+        for (int k = 0; k < plan.n_cpx/2; k++) {
+            const double phase = -M_PI*((double) (k + 1)/plan.n_cpx + 0.5);
+            plan.super_twiddles[k] = { (float) cos(phase), (float) sin(phase) };
+        }
+    }
 
-        for (int n = 0; n < N; n++) {
-            float angle = 2*M_PI*k*n/N;
-            re += in[n]*cos(angle);
-            im -= in[n]*sin(angle);
+    // factor out 4s first, then 2s, then odd primes
+    plan.factors.clear();
+    plan.max_radix = 1;
+    {
+        int m = plan.n_cpx;
+        int p = 4;
+        const int floor_sqrt = (int) floor(sqrt((double) m));
+        while (m > 1) {
+            while (m%p) {
+                switch (p) {
+                    case 4:  p = 2; break;
+                    case 2:  p = 3; break;
+                    default: p += 2; break;
+                }
+                if (p > floor_sqrt) {
+                    p = m;
+                }
+            }
+            m /= p;
+            plan.factors.push_back(p);
+            plan.factors.push_back(m);
+            plan.max_radix = std::max(plan.max_radix, p);
         }
+        if (plan.factors.empty()) {
+            plan.factors.push_back(1);
+            plan.factors.push_back(1);
+        }
+    }
+
+    return true;
+}
 
-        out[k*2 + 0] = re;
-        out[k*2 + 1] = im;
+static void whisper_fft_bfly2(whisper_cpx * out, const whisper_fft_plan & plan, int fstride, int m) {
+    const whisper_cpx * tw = plan.twiddles.data();
+    whisper_cpx * out2 = out + m;
+    for (int k = 0; k < m; k++) {
+        const whisper_cpx t = whisper_cpx_mul(out2[k], tw[k*fstride]);
+        out2[k] = { out[k].r - t.r, out[k].i - t.i };
+        out[k].r += t.r;
+        out[k].i += t.i;
     }
 }
 
-// Cooley-Tukey FFT
-// poor man's implementation - use something better
-// input is real-valued
-// output is complex-valued
-void fft(const std::vector<float> & in, std::vector<float> & out) {
-    out.resize(in.size()*2);
+static void whisper_fft_bfly3(whisper_cpx * out, const whisper_fft_plan & plan, int fstride, int m) {
+    const whisper_cpx * tw = plan.twiddles.data();
+    const float epi3 = tw[fstride*m].i;
+    for (int k = 0; k < m; k++) {
+        const whisper_cpx s1 = whisper_cpx_mul(out[k + m],   tw[k*fstride]);
+        const whisper_cpx s2 = whisper_cpx_mul(out[k + 2*m], tw[2*k*fstride]);
+        const whisper_cpx s3 = { s1.r + s2.r, s1.i + s2.i };
+        const whisper_cpx s0 = { (s1.r - s2.r)*epi3, (s1.i - s2.i)*epi3 };
 
-    int N = in.size();
+        out[k + m] = { out[k].r - 0.5f*s3.r, out[k].i - 0.5f*s3.i };
+        out[k].r += s3.r;
+        out[k].i += s3.i;
 
-    if (N == 1) {
-        out[0] = in[0];
-        out[1] = 0;
-        return;
+        out[k + 2*m] = { out[k + m].r + s0.i, out[k + m].i - s0.r };
+        out[k + m].r -= s0.i;
+        out[k + m].i += s0.r;
     }
+}
 
-    if (N%2 == 1) {
-        dft(in, out);
-        return;
+static void whisper_fft_bfly4(whisper_cpx * out, const whisper_fft_plan & plan, int fstride, int m) {
+    const whisper_cpx * tw = plan.twiddles.data();
+    for (int k = 0; k < m; k++) {
+        const whisper_cpx s0 = whisper_cpx_mul(out[k + m],   tw[k*fstride]);
+        const whisper_cpx s1 = whisper_cpx_mul(out[k + 2*m], tw[2*k*fstride]);
+        const whisper_cpx s2 = whisper_cpx_mul(out[k + 3*m], tw[3*k*fstride]);
+
+        const whisper_cpx s5 = { out[k].r - s1.r, out[k].i - s1.i };
+        out[k].r += s1.r;
+        out[k].i += s1.i;
+
+        const whisper_cpx s3 = { s0.r + s2.r, s0.i + s2.i };
+        const whisper_cpx s4 = { s0.r - s2.r, s0.i - s2.i };
+
+        out[k + 2*m] = { out[k].r - s3.r, out[k].i - s3.i };
+        out[k].r += s3.r;
+        out[k].i += s3.i;
+
+        out[k + m]   = { s5.r + s4.i, s5.i - s4.r };
+        out[k + 3*m] = { s5.r - s4.i, s5.i + s4.r };
     }
+}
 
-    std::vector<float> even;
-    std::vector<float> odd;
+static void whisper_fft_bfly5(whisper_cpx * out, const whisper_fft_plan & plan, int fstride, int m) {
+    const whisper_cpx * tw = plan.twiddles.data();
+    const whisper_cpx ya = tw[fstride*m];
+    const whisper_cpx yb = tw[fstride*2*m];
 
-    for (int i = 0; i < N; i++) {
-        if (i % 2 == 0) {
-            even.push_back(in[i]);
-        } else {
-            odd.push_back(in[i]);
+    whisper_cpx * f0 = out;
+    whisper_cpx * f1 = out + m;
+    whisper_cpx * f2 = out + 2*m;
+    whisper_cpx * f3 = out + 3*m;
+    whisper_cpx * f4 = out + 4*m;
+
+    for (int u = 0; u < m; u++) {
+        const whisper_cpx s0 = f0[u];
+        const whisper_cpx s1 = whisper_cpx_mul(f1[u], tw[u*fstride]);
+        const whisper_cpx s2 = whisper_cpx_mul(f2[u], tw[2*u*fstride]);
+        const whisper_cpx s3 = whisper_cpx_mul(f3[u], tw[3*u*fstride]);
+        const whisper_cpx s4 = whisper_cpx_mul(f4[u], tw[4*u*fstride]);
+
+        const whisper_cpx s7  = { s1.r + s4.r, s1.i + s4.i };
+        const whisper_cpx s10 = { s1.r - s4.r, s1.i - s4.i };
+        const whisper_cpx s8  = { s2.r + s3.r, s2.i + s3.i };
+        const whisper_cpx s9  = { s2.r - s3.r, s2.i - s3.i };
+
+        f0[u] = { s0.r + s7.r + s8.r, s0.i + s7.i + s8.i };
+
+        const whisper_cpx s5 = { s0.r + s7.r*ya.r + s8.r*yb.r, s0.i + s7.i*ya.r + s8.i*yb.r };
+        const whisper_cpx s6 = { s10.i*ya.i + s9.i*yb.i, -s10.r*ya.i - s9.r*yb.i };
+
+        f1[u] = { s5.r - s6.r, s5.i - s6.i };
+        f4[u] = { s5.r + s6.r, s5.i + s6.i };
+
+        const whisper_cpx s11 = { s0.r + s7.r*yb.r + s8.r*ya.r, s0.i + s7.i*yb.r + s8.i*ya.r };
+        const whisper_cpx s12 = { -s10.i*yb.i + s9.i*ya.i, s10.r*yb.i - s9.r*ya.i };
+
+        f2[u] = { s11.r + s12.r, s11.i + s12.i };
+        f3[u] = { s11.r - s12.r, s11.i - s12.i };
+    }
+}
+
+static void whisper_fft_bfly_generic(whisper_cpx * out, const whisper_fft_plan & plan, int fstride, int m, int p, whisper_cpx * scratch) {
+    const whisper_cpx * tw = plan.twiddles.data();
+    const int n = plan.n_cpx;
+
+    for (int u = 0; u < m; u++) {
+        for (int q1 = 0, k = u; q1 < p; q1++, k += m) {
+            scratch[q1] = out[k];
+        }
+
+        for (int q1 = 0, k = u; q1 < p; q1++, k += m) {
+            int twidx = 0;
+            out[k] = scratch[0];
+            for (int q = 1; q < p; q++) {
+                twidx += fstride*k;
+                if (twidx >= n) {
+                    twidx -= n;
+                }
+                const whisper_cpx t = whisper_cpx_mul(scratch[q], tw[twidx]);
+                out[k].r += t.r;
+                out[k].i += t.i;
+            }
+        }
+    }
+}
+
+// decimation in time, recursing over the factor list (depth = number of factors)
+static void whisper_fft_work(
+        whisper_cpx * out,
+        const whisper_cpx * in,
+        int fstride,
+        const int * factors,
+        const whisper_fft_plan & plan,
+        whisper_cpx * scratch) {
+    const int p = factors[0]; // radix
+    const int m = factors[1]; // stage length / radix
+
+    whisper_cpx * out_beg = out;
+    const whisper_cpx * out_end = out + p*m;
+
+    if (m == 1) {
+        do {
+            *out = *in;
+            in += fstride;
+        } while (++out != out_end);
+    } else {
+        do {
+            whisper_fft_work(out, in, fstride*p, factors + 2, plan, scratch);
+            in += fstride;
+        } while ((out += m) != out_end);
+    }
+
+    out = out_beg;
+
+    switch (p) {
+        case 1:  break;
+        case 2:  whisper_fft_bfly2(out, plan, fstride, m); break;
+        case 3:  whisper_fft_bfly3(out, plan, fstride, m); break;
+        case 4:  whisper_fft_bfly4(out, plan, fstride, m); break;
+        case 5:  whisper_fft_bfly5(out, plan, fstride, m); break;
+        default: whisper_fft_bfly_generic(out, plan, fstride, m, p, scratch); break;
+    }
+}
+
+// real-valued input of plan.n samples
+// complex-valued output of plan.n/2 + 1 bins, interleaved re/im
+// scratch must hold plan.n_scratch() floats
+void whisper_fft_forward(const whisper_fft_plan & plan, const float * in, float * out, float * scratch) {
+    whisper_cpx * tmp  = (whisper_cpx *) scratch;
+    whisper_cpx * work = tmp + plan.n_cpx;
+    whisper_cpx * bfly = work + plan.n_cpx;
+    whisper_cpx * dst  = (whisper_cpx *) out;
+
+    if (!plan.packed) {
+        for (int i = 0; i < plan.n; i++) {
+            work[i] = { in[i], 0.0f };
         }
+        whisper_fft_work(tmp, work, 1, plan.factors.data(), plan, bfly);
+        for (int k = 0; k <= plan.n/2; k++) {
+            dst[k] = tmp[k];
+        }
+        return;
     }
 
-    std::vector<float> even_fft;
-    std::vector<float> odd_fft;
+    const int ncfft = plan.n_cpx;
 
-    fft(even, even_fft);
-    fft(odd, odd_fft);
+    whisper_fft_work(tmp, (const whisper_cpx *) in, 1, plan.factors.data(), plan, bfly);
 
-    for (int k = 0; k < N/2; k++) {
-        float theta = 2*M_PI*k/N;
+    dst[0]     = { tmp[0].r + tmp[0].i, 0.0f };
+    dst[ncfft] = { tmp[0].r - tmp[0].i, 0.0f };
 
-        float re = cos(theta);
-        float im = -sin(theta);
+    for (int k = 1; k <= ncfft/2; k++) {
+        const whisper_cpx fpk  = tmp[k];
+        const whisper_cpx fpnk = { tmp[ncfft - k].r, -tmp[ncfft - k].i };
 
-        float re_odd = odd_fft[2*k + 0];
-        float im_odd = odd_fft[2*k + 1];
+        const whisper_cpx f1k = { fpk.r + fpnk.r, fpk.i + fpnk.i };
+        const whisper_cpx f2k = { fpk.r - fpnk.r, fpk.i - fpnk.i };
+        const whisper_cpx tw  = whisper_cpx_mul(f2k, plan.super_twiddles[k - 1]);
 
-        out[2*k + 0] = even_fft[2*k + 0] + re*re_odd - im*im_odd;
-        out[2*k + 1] = even_fft[2*k + 1] + re*im_odd + im*re_odd;
+        dst[k]         = { 0.5f*(f1k.r + tw.r), 0.5f*(f1k.i + tw.i) };
+        dst[ncfft - k] = { 0.5f*(f1k.r - tw.r), 0.5f*(tw.i - f1k.i) };
+    }
+}
+
+// plans are built on first use and shared by all threads
+const whisper_fft_plan & whisper_fft_get_plan(int n) {
+    static std::mutex mutex;
+    static std::map<int, std::unique_ptr<whisper_fft_plan>> plans;
+
+    std::lock_guard<std::mutex> lock(mutex);
 
-        out[2*(k + N/2) + 0] = even_fft[2*k + 0] - re*re_odd + im*im_odd;
-        out[2*(k + N/2) + 1] = even_fft[2*k + 1] - re*im_odd - im*re_odd;
+    auto & plan = plans[n];
+    if (!plan) {
+        plan.reset(new whisper_fft_plan());
+        whisper_fft_plan_init(*plan, n);
     }
+
+    return *plan;
 }
 
-// ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L92-L124
-bool log_mel_spectrogram(
-        const float * samples,
-        const int n_samples,
-        const int sample_rate,
-        const int fft_size,
-        const int fft_step,
-        const int n_mel,
-        const int n_threads,
-        const whisper_filters & filters,
-        whisper_mel & mel) {
+// FFT backends behind the mel front end
+// builtin: the planned FFT above
+// avtx:    FFmpeg's libavutil/tx RDFT
+// eigen:   Eigen's kissfft based Eigen::FFT
+// instances keep mutable state (scratch, contexts, plan caches), so every
+// thread creates its own with whisper_fft_backend_create()
+enum whisper_fft_backend_type {
+    WHISPER_FFT_BUILTIN = 0,
+    WHISPER_FFT_AVTX    = 1,
+    WHISPER_FFT_EIGEN   = 2,
+    WHISPER_FFT_COUNT,
+};
 
-    // Hanning window
-    std::vector<float> hann;
-    hann.resize(fft_size);
-    for (int i = 0; i < fft_size; i++) {
-        hann[i] = 0.5*(1.0 - cos((2.0*M_PI*i)/(fft_size)));
+static const char * whisper_fft_backend_names[WHISPER_FFT_COUNT] = {
+    "builtin",
+    "avtx",
+    "eigen",
+};
+
+class whisper_fft_backend {
+public:
+    virtual ~whisper_fft_backend() = default;
+
+    virtual whisper_fft_backend_type type() const = 0;
+
+    // real-valued input of n samples
+    // complex-valued output of n/2 + 1 bins, interleaved re/im
+    virtual void forward(const float * in, float * out) = 0;
+};
+
+class whisper_fft_builtin : public whisper_fft_backend {
+public:
+    explicit whisper_fft_builtin(int n) : m_plan(whisper_fft_get_plan(n)), m_scratch(m_plan.n_scratch()) {}
+
+    whisper_fft_backend_type type() const override {
+        return WHISPER_FFT_BUILTIN;
     }
 
-    mel.n_mel = n_mel;
-    mel.n_len = (n_samples)/fft_step;
-    mel.data.resize(mel.n_mel*mel.n_len);
+    void forward(const float * in, float * out) override {
+        whisper_fft_forward(m_plan, in, out, m_scratch.data());
+    }
 
-    const int n_fft = 1 + fft_size/2;
+private:
+    const whisper_fft_plan & m_plan;
+    std::vector<float> m_scratch;
+};
 
-    //printf("%s: n_samples = %d, n_len = %d\n", __func__, n_samples, mel.n_len);
-    //printf("%s: recording length: %f s\n", __func__, (float) n_samples/sample_rate);
+class whisper_fft_avtx : public whisper_fft_backend {
+public:
+    ~whisper_fft_avtx() override {
+        av_tx_uninit(&m_ctx);
+    }
 
-    std::vector<std::thread> workers(n_threads);
-    for (int iw = 0; iw < n_threads; ++iw) {
-        workers[iw] = std::thread([&](int ith) {
-            std::vector<float> fft_in;
-            fft_in.resize(fft_size);
-            for (int i = 0; i < fft_size; i++) {
-                fft_in[i] = 0.0;
-            }
+    bool init(int n) {
+        const float scale = 1.0f;
+        return av_tx_init(&m_ctx, &m_fn, AV_TX_FLOAT_RDFT, 0, n, &scale, AV_TX_UNALIGNED) == 0;
+    }
 
-            std::vector<float> fft_out;
-            fft_out.resize(2*fft_size);
+    whisper_fft_backend_type type() const override {
+        return WHISPER_FFT_AVTX;
+    }
 
-            for (int i = ith; i < mel.n_len; i += n_threads) {
-                const int offset = i*fft_step;
+    void forward(const float * in, float * out) override {
+        m_fn(m_ctx, out, (void *) in, sizeof(float));
+    }
 
-                // apply Hanning window
-                for (int j = 0; j < fft_size; j++) {
-                    if (offset + j < n_samples) {
-                        fft_in[j] = hann[j]*samples[offset + j];
-                    } else {
-                        fft_in[j] = 0.0;
-                    }
-                }
+private:
+    AVTXContext * m_ctx = nullptr;
+    av_tx_fn m_fn = nullptr;
+};
 
-                // FFT -> mag^2
-                fft(fft_in, fft_out);
+class whisper_fft_eigen : public whisper_fft_backend {
+public:
+    explicit whisper_fft_eigen(int n) : m_n(n), m_out(n/2 + 1) {
+        m_fft.SetFlag(Eigen::FFT<float>::HalfSpectrum);
+    }
 
-                for (int j = 0; j < fft_size; j++) {
-                    fft_out[j] = (fft_out[2*j + 0]*fft_out[2*j + 0] + fft_out[2*j + 1]*fft_out[2*j + 1]);
-                }
-                for (int j = 1; j < fft_size/2; j++) {
-                    //if (i == 0) {
-                    //    printf("%d: %f %f\n", j, fft_out[j], fft_out[fft_size - j]);
-                    //}
-                    fft_out[j] += fft_out[fft_size - j];
-                }
-                if (i == 0) {
-                    //for (int j = 0; j < fft_size; j++) {
-                    //    printf("%d: %e\n", j, fft_out[j]);
-                    //}
-                }
+    whisper_fft_backend_type type() const override {
+        return WHISPER_FFT_EIGEN;
+    }
 
-                // mel spectrogram
-                for (int j = 0; j < mel.n_mel; j++) {
-                    double sum = 0.0;
+    void forward(const float * in, float * out) override {
+        m_fft.fwd(m_out.data(), in, m_n);
+        memcpy(out, m_out.data(), m_out.size()*sizeof(std::complex<float>));
+    }
 
-                    for (int k = 0; k < n_fft; k++) {
-                        sum += fft_out[k]*filters.data[j*n_fft + k];
-                    }
-                    if (sum < 1e-10) {
-                        sum = 1e-10;
-                    }
+private:
+    const int m_n;
+    Eigen::FFT<float> m_fft;
+    std::vector<std::complex<float>> m_out;
+};
 
-                    sum = log10(sum);
+// backend used by log_mel_spectrogram and whisper_mel_stream
+std::atomic<int> g_whisper_fft_backend{WHISPER_FFT_BUILTIN};
 
-                    mel.data[j*mel.n_len + i] = sum;
+// nullptr if the backend cannot do a transform of size n
+std::unique_ptr<whisper_fft_backend> whisper_fft_backend_create(whisper_fft_backend_type type, int n) {
+    switch (type) {
+        case WHISPER_FFT_BUILTIN:
+            return std::unique_ptr<whisper_fft_backend>(new whisper_fft_builtin(n));
+        case WHISPER_FFT_AVTX:
+            {
+                std::unique_ptr<whisper_fft_avtx> fft(new whisper_fft_avtx());
+                if (n%2 != 0 || !fft->init(n)) {
+                    return nullptr;
                 }
+                return std::unique_ptr<whisper_fft_backend>(fft.release());
             }
-        }, iw);
+        case WHISPER_FFT_EIGEN:
+            return std::unique_ptr<whisper_fft_backend>(new whisper_fft_eigen(n));
+        default:
+            return nullptr;
     }
+}
 
-    for (int iw = 0; iw < n_threads; ++iw) {
-        workers[iw].join();
+// the selected backend, or the builtin one if it is not available
+std::unique_ptr<whisper_fft_backend> whisper_fft_backend_create(int n) {
+    auto fft = whisper_fft_backend_create((whisper_fft_backend_type) g_whisper_fft_backend.load(), n);
+    if (!fft) {
+        fft = whisper_fft_backend_create(WHISPER_FFT_BUILTIN, n);
     }
+    return fft;
+}
 
-    // clamping and normalization
-    double mmax = -1e20;
-    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
-        if (mel.data[i] > mmax) {
-            mmax = mel.data[i];
+// select a backend by name, returns false for unknown or unavailable ones
+bool whisper_fft_backend_select(const char * name) {
+    for (int i = 0; i < WHISPER_FFT_COUNT; i++) {
+        if (strcmp(name, whisper_fft_backend_names[i]) == 0) {
+            if (!whisper_fft_backend_create((whisper_fft_backend_type) i, WHISPER_N_FFT)) {
+                return false;
+            }
+            g_whisper_fft_backend = i;
+            return true;
         }
     }
-    //printf("%s: max = %f\n", __func__, mmax);
+    return false;
+}
+
+struct whisper_fft_bench_result {
+    whisper_fft_backend_type type;
+    bool available = false;
+    double ns_per_frame = 0.0;
+    double max_err = 0.0; // largest abs. difference to the builtin backend
+};
+
+// time n_frames forward transforms of size n with every backend on this CPU
+std::vector<whisper_fft_bench_result> whisper_fft_benchmark(int n = WHISPER_N_FFT, int n_frames = 3000) {
+    std::vector<float> in(n);
+    uint32_t seed = 12345;
+    for (int i = 0; i < n; i++) {
+        seed = seed*1664525u + 1013904223u;
+        in[i] = (float) (seed >> 8)/(1 << 23) - 1.0f;
+    }
 
-    mmax -= 8.0;
+    std::vector<float> ref(2*(n/2 + 1));
+    std::vector<float> out(2*(n/2 + 1));
+    whisper_fft_backend_create(WHISPER_FFT_BUILTIN, n)->forward(in.data(), ref.data());
 
-    for (int i = 0; i < mel.n_mel*mel.n_len; i++) {
-        if (mel.data[i] < mmax) {
-            mel.data[i] = mmax;
+    std::vector<whisper_fft_bench_result> results;
+    for (int i = 0; i < WHISPER_FFT_COUNT; i++) {
+        whisper_fft_bench_result res;
+        res.type = (whisper_fft_backend_type) i;
+
+        auto fft = whisper_fft_backend_create(res.type, n);
+        if (fft) {
+            res.available = true;
+
+            // warm-up, lets lazily planned backends build their tables
+            fft->forward(in.data(), out.data());
+            for (size_t k = 0; k < out.size(); k++) {
+                res.max_err = std::max(res.max_err, (double) fabs(out[k] - ref[k]));
+            }
+
+            const auto t0 = std::chrono::steady_clock::now();
+            for (int f = 0; f < n_frames; f++) {
+                fft->forward(in.data(), out.data());
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+
+            res.ns_per_frame = std::chrono::duration<double, std::nano>(t1 - t0).count()/n_frames;
         }
 
-        mel.data[i] = (mel.data[i] + 4.0)/4.0;
+        results.push_back(res);
     }
 
-    return true;
-}
\ No newline at end of file
+    return results;
+}
+
+// run the benchmark and keep the fastest backend that agrees with the builtin one
+whisper_fft_backend_type whisper_fft_backend_select_fastest() {
+    whisper_fft_backend_type best = WHISPER_FFT_BUILTIN;
+    double best_ns = 1e30;
+    for (const auto & res : whisper_fft_benchmark()) {
+        if (res.available && res.max_err < 1e-3 && res.ns_per_frame < best_ns) {
+            best    = res.type;
+            best_ns = res.ns_per_frame;
+        }
+    }
+    g_whisper_fft_backend = best;
+    return best;
+}
+
+// each triangular mel filter only touches a handful of consecutive bins
+// keep just that band, padded with zeros to a multiple of 4 weights so that the
+// kernel below never needs a scalar tail
+void whisper_filters_build_bands(whisper_filters & filters) {
+    const int n_mel = filters.n_mel;
+    const int n_fft = filters.n_fft;
+
+    filters.band_start.resize(n_mel);
+    filters.band_len.resize(n_mel);
+    filters.band_offset.resize(n_mel);
+    filters.band_data.clear();
+
+    for (int j = 0; j < n_mel; j++) {
+        const float * row = filters.data.data() + j*n_fft;
+
+        int k0 = 0;
+        while (k0 < n_fft && row[k0] == 0.0f) {
+            k0++;
+        }
+        int k1 = n_fft;
+        while (k1 > k0 && row[k1 - 1] == 0.0f) {
+            k1--;
+        }
+
+        int len = (k1 - k0 + 3) & ~3;
+        if (len > n_fft) {
+            len = n_fft;
+        }
+        // grow to the left rather than reading past the last bin
+        if (k0 + len > n_fft) {
+            k0 = n_fft - len;
+        }
+
+        filters.band_start[j]  = k0;
+        filters.band_len[j]    = len;
+        filters.band_offset[j] = (int32_t) filters.band_data.size();
+        filters.band_data.insert(filters.band_data.end(), row + k0, row + k0 + len);
+    }
+}
+
+// float32 dot product, n is a multiple of 4 except for degenerate filterbanks
+static inline float whisper_vec_dot_f32(const float * a, const float * b, int n) {
+    int i = 0;
+    float sum = 0.0f;
+
+#if defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (; i + 4 <= n; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+#if defined(__aarch64__)
+    sum = vaddvq_f32(acc);
+#else
+    const float32x2_t acc2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(acc2, acc2), 0);
+#endif
+#elif defined(__AVX__) || defined(__SSE__)
+    __m128 acc = _mm_setzero_ps();
+#if defined(__AVX__)
+    __m256 acc8 = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc8 = _mm256_add_ps(acc8, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    acc = _mm_add_ps(_mm256_castps256_ps128(acc8), _mm256_extractf128_ps(acc8, 1));
+#endif
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#endif
+
+    for (; i < n; i++) {
+        sum += a[i]*b[i];
+    }
+
+    return sum;
+}
+
+// log10(max(x, 1e-10)) in place, float32
+// frexp + Cephes logf polynomial on [sqrt(1/2), sqrt(2)), evaluated with NEON/SSE
+// when available and with the same arithmetic in the scalar tail
+// max abs. error vs double precision log10 over [1e-10, 1e8]: 1.2e-6, about one
+// float ulp of results of that magnitude and far below the 8.0 dynamic range
+// kept by the clamp applied afterwards
+#define WHISPER_LOG_P0  7.0376836292e-2f
+#define WHISPER_LOG_P1 -1.1514610310e-1f
+#define WHISPER_LOG_P2  1.1676998740e-1f
+#define WHISPER_LOG_P3 -1.2420140846e-1f
+#define WHISPER_LOG_P4  1.4249322787e-1f
+#define WHISPER_LOG_P5 -1.6668057665e-1f
+#define WHISPER_LOG_P6  2.0000714765e-1f
+#define WHISPER_LOG_P7 -2.4999993993e-1f
+#define WHISPER_LOG_P8  3.3333331174e-1f
+#define WHISPER_LOG_SQRTHF 0.707106781186547524f
+#define WHISPER_LOG_LOG10E 0.434294481903251828f
+
+static inline float whisper_log10_f32(float x) {
+    x = std::max(x, 1e-10f);
+
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+
+    float e = (float) ((int) (bits >> 23) - 126);
+    bits = (bits & 0x007fffffu) | 0x3f000000u; // mantissa in [0.5, 1)
+
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+
+    if (m < WHISPER_LOG_SQRTHF) {
+        e -= 1.0f;
+        m = m + m - 1.0f;
+    } else {
+        m = m - 1.0f;
+    }
+
+    const float z = m*m;
+
+    float y = WHISPER_LOG_P0;
+    y = y*m + WHISPER_LOG_P1;
+    y = y*m + WHISPER_LOG_P2;
+    y = y*m + WHISPER_LOG_P3;
+    y = y*m + WHISPER_LOG_P4;
+    y = y*m + WHISPER_LOG_P5;
+    y = y*m + WHISPER_LOG_P6;
+    y = y*m + WHISPER_LOG_P7;
+    y = y*m + WHISPER_LOG_P8;
+    y = y*m*z;
+
+    y += -2.12194440e-4f*e;
+    y += -0.5f*z;
+
+    return (m + y + 0.693359375f*e)*WHISPER_LOG_LOG10E;
+}
+
+static inline void whisper_vec_log10_f32(float * x, int n) {
+    int i = 0;
+
+#if defined(__ARM_NEON)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vmaxq_f32(vld1q_f32(x + i), vdupq_n_f32(1e-10f));
+
+        const uint32x4_t bits = vreinterpretq_u32_f32(v);
+        float32x4_t e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(126)));
+        float32x4_t m = vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007fffffu)), vdupq_n_u32(0x3f000000u)));
+
+        const uint32x4_t mask = vcltq_f32(m, vdupq_n_f32(WHISPER_LOG_SQRTHF));
+        e = vsubq_f32(e, vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(one), mask)));
+        m = vaddq_f32(vsubq_f32(m, one), vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(m), mask)));
+
+        const float32x4_t z = vmulq_f32(m, m);
+
+        float32x4_t y = vdupq_n_f32(WHISPER_LOG_P0);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P1), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P2), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P3), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P4), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P5), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P6), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P7), y, m);
+        y = vmlaq_f32(vdupq_n_f32(WHISPER_LOG_P8), y, m);
+        y = vmulq_f32(vmulq_f32(y, m), z);
+
+        y = vmlaq_f32(y, e, vdupq_n_f32(-2.12194440e-4f));
+        y = vmlaq_f32(y, z, vdupq_n_f32(-0.5f));
+
+        v = vmlaq_f32(vaddq_f32(m, y), e, vdupq_n_f32(0.693359375f));
+        vst1q_f32(x + i, vmulq_f32(v, vdupq_n_f32(WHISPER_LOG_LOG10E)));
+    }
+#elif defined(__SSE2__)
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_max_ps(_mm_loadu_ps(x + i), _mm_set1_ps(1e-10f));
+
+        const __m128i bits = _mm_castps_si128(v);
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+        __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f000000)));
+
+        const __m128 mask = _mm_cmplt_ps(m, _mm_set1_ps(WHISPER_LOG_SQRTHF));
+        e = _mm_sub_ps(e, _mm_and_ps(one, mask));
+        m = _mm_add_ps(_mm_sub_ps(m, one), _mm_and_ps(m, mask));
+
+        const __m128 z = _mm_mul_ps(m, m);
+
+        __m128 y = _mm_set1_ps(WHISPER_LOG_P0);
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P1));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P2));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P3));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P4));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P5));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P6));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P7));
+        y = _mm_add_ps(_mm_mul_ps(y, m), _mm_set1_ps(WHISPER_LOG_P8));
+        y = _mm_mul_ps(_mm_mul_ps(y, m), z);
+
+        y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+        y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+
+        v = _mm_add_ps(_mm_add_ps(m, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+        _mm_storeu_ps(x + i, _mm_mul_ps(v, _mm_set1_ps(WHISPER_LOG_LOG10E)));
+    }
+#endif
+
+    for (; i < n; i++) {
+        x[i] = whisper_log10_f32(x[i]);
+    }
+}
+
+// largest of n floats
+static inline float whisper_vec_max_f32(const float * x, int n) {
+    int i = 0;
+    float mmax = -1e20f;
+
+#if defined(__ARM_NEON)
+    if (n >= 4) {
+        float32x4_t acc = vld1q_f32(x);
+        for (i = 4; i + 4 <= n; i += 4) {
+            acc = vmaxq_f32(acc, vld1q_f32(x + i));
+        }
+        const float32x2_t acc2 = vpmax_f32(vget_low_f32(acc), vget_high_f32(acc));
+        mmax = vget_lane_f32(vpmax_f32(acc2, acc2), 0);
+    }
+#elif defined(__SSE__)
+    if (n >= 4) {
+        __m128 acc = _mm_loadu_ps(x);
+        for (i = 4; i + 4 <= n; i += 4) {
+            acc = _mm_max_ps(acc, _mm_loadu_ps(x + i));
+        }
+        acc = _mm_max_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_max_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        mmax = _mm_cvtss_f32(acc);
+    }
+#endif
+
+    for (; i < n; i++) {
+        mmax = std::max(mmax, x[i]);
+    }
+
+    return mmax;
+}
+
+// project a power spectrum of n_fft bins onto the mel filters
+template <int N_MEL = 0>
+static inline void whisper_filters_apply(const whisper_filters & filters, const float * power, float * out) {
+    const int n_mel = N_MEL > 0 ? N_MEL : filters.n_mel;
+    const float * data = filters.band_data.data();
+    for (int j = 0; j < n_mel; j++) {
+        out[j] = whisper_vec_dot_f32(power + filters.band_start[j], data + filters.band_offset[j], filters.band_len[j]);
+    }
+}
+
+// persistent worker pool
+// threads are created on the first job and live until the pool is destroyed
+// a job [0, n) is cut into chunks, every thread starts on its own contiguous
+// share of the chunks and steals chunks from the other shares once it runs dry
+class whisper_thread_pool {
+public:
+    // n_threads counts the calling thread, 0 = hardware concurrency
+    explicit whisper_thread_pool(int n_threads = 0) {
+        if (n_threads <= 0) {
+            n_threads = (int) std::thread::hardware_concurrency();
+        }
+        m_n_threads = std::max(1, n_threads);
+    }
+
+    ~whisper_thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv_job.notify_all();
+        for (auto & worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    whisper_thread_pool(const whisper_thread_pool &) = delete;
+    whisper_thread_pool & operator=(const whisper_thread_pool &) = delete;
+
+    int n_threads() const {
+        return m_n_threads;
+    }
+
+    // calls fn(begin, end, ith) on sub-ranges of [0, n) of at most chunk items
+    // ith identifies the executing thread in [0, n_threads()) for per-thread scratch
+    // the calling thread takes part in the work, blocks until everything is done
+    // jobs must not be submitted concurrently or from inside fn
+    void parallel_for(int n, int chunk, const std::function<void(int, int, int)> & fn) {
+        if (n <= 0) {
+            return;
+        }
+        chunk = std::max(1, chunk);
+
+        const int n_chunks = (n + chunk - 1)/chunk;
+        if (m_n_threads == 1 || n_chunks == 1) {
+            for (int i = 0; i < n; i += chunk) {
+                fn(i, std::min(n, i + chunk), 0);
+            }
+            return;
+        }
+
+        start();
+
+        m_n     = n;
+        m_chunk = chunk;
+        m_fn    = &fn;
+        for (int ith = 0; ith < m_n_threads; ith++) {
+            m_shares[ith].next.store((int) ((int64_t) n_chunks*ith/m_n_threads), std::memory_order_relaxed);
+            m_shares[ith].end = (int) ((int64_t) n_chunks*(ith + 1)/m_n_threads);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_n_busy = m_n_threads - 1;
+            m_generation++;
+        }
+        m_cv_job.notify_all();
+
+        run(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_done.wait(lock, [this] { return m_n_busy == 0; });
+        m_fn = nullptr;
+    }
+
+private:
+    struct alignas(64) share {
+        std::atomic<int> next{0};
+        int end = 0;
+    };
+
+    void start() {
+        if (!m_workers.empty()) {
+            return;
+        }
+        m_shares.reset(new share[m_n_threads]);
+        for (int ith = 1; ith < m_n_threads; ith++) {
+            m_workers.emplace_back(&whisper_thread_pool::loop, this, ith);
+        }
+    }
+
+    void loop(int ith) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv_job.wait(lock, [&] { return m_stop || m_generation != seen; });
+                if (m_stop) {
+                    return;
+                }
+                seen = m_generation;
+            }
+
+            run(ith);
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_n_busy--;
+            }
+            m_cv_done.notify_one();
+        }
+    }
+
+    // drain the own share first, then walk the other shares and steal
+    void run(int ith) {
+        for (int k = 0; k < m_n_threads; k++) {
+            share & victim = m_shares[(ith + k)%m_n_threads];
+            while (true) {
+                const int c = victim.next.fetch_add(1, std::memory_order_relaxed);
+                if (c >= victim.end) {
+                    break;
+                }
+                const int begin = c*m_chunk;
+                (*m_fn)(begin, std::min(m_n, begin + m_chunk), ith);
+            }
+        }
+    }
+
+    int m_n_threads = 1;
+
+    std::vector<std::thread> m_workers;
+    std::unique_ptr<share[]> m_shares;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv_job;
+    std::condition_variable m_cv_done;
+
+    uint64_t m_generation = 0;
+    int m_n_busy = 0;
+    bool m_stop = false;
+
+    int m_n = 0;
+    int m_chunk = 1;
+    const std::function<void(int, int, int)> * m_fn = nullptr;
+};
+
+// owned by the transcription engine, shared by every segment and every job
+whisper_thread_pool g_whisper_pool;
+
+// bounded blocking queue between the stages of a pipeline
+// push() blocks while the queue is full and pop() while it is empty, so a fast
+// stage can run at most capacity items ahead of the next one
+// close() wakes everybody: push() fails from then on, pop() drains what is left
+template <typename T>
+class whisper_queue {
+public:
+    explicit whisper_queue(size_t capacity) : m_capacity(std::max<size_t>(1, capacity)) {}
+
+    bool push(T value) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_push.wait(lock, [&] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) {
+            return false;
+        }
+        m_items.push_back(std::move(value));
+        m_cv_pop.notify_one();
+        return true;
+    }
+
+    bool pop(T & value) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv_pop.wait(lock, [&] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) {
+            return false;
+        }
+        value = std::move(m_items.front());
+        m_items.pop_front();
+        m_cv_push.notify_one();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_cv_push.notify_all();
+        m_cv_pop.notify_all();
+    }
+
+private:
+    const size_t m_capacity;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv_push;
+    std::condition_variable m_cv_pop;
+    std::deque<T> m_items;
+    bool m_closed = false;
+};
+
+// non-owning view of the input audio at WHISPER_SAMPLE_RATE
+// either mono float samples, or interleaved int16 samples with 1 or 2 channels
+// that are scaled (and downmixed) on the fly while frames are windowed, so no
+// float copy of the file is ever made
+struct whisper_pcm {
+    const float   * f32 = nullptr;
+    const int16_t * s16 = nullptr;
+
+    int n_channels = 1;
+    int n_samples  = 0; // per channel
+};
+
+static inline whisper_pcm whisper_pcm_f32(const float * samples, int n_samples) {
+    whisper_pcm pcm;
+    pcm.f32       = samples;
+    pcm.n_samples = n_samples;
+    return pcm;
+}
+
+static inline whisper_pcm whisper_pcm_s16(const int16_t * samples, int n_samples, int n_channels) {
+    whisper_pcm pcm;
+    pcm.s16        = samples;
+    pcm.n_channels = n_channels;
+    pcm.n_samples  = n_samples;
+    return pcm;
+}
+
+// dst[j] = x[offset + j] as mono float for j < n, zero past the end of the input
+// for int16 input x is s/32768 (mono) or (l + r)/65536 (stereo)
+static void whisper_pcm_read(const whisper_pcm & pcm, int offset, int n_read, float * dst) {
+    const int n = std::max(0, std::min(n_read, pcm.n_samples - offset));
+
+    int j = 0;
+    if (pcm.f32) {
+        const float * x = pcm.f32 + offset;
+        memcpy(dst, x, n*sizeof(float));
+        j = n;
+    } else if (pcm.n_channels == 1) {
+        const int16_t * x = pcm.s16 + offset;
+        const float scale = 1.0f/32768.0f;
+#if defined(__ARM_NEON)
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; j + 4 <= n; j += 4) {
+            const float32x4_t v = vcvtq_f32_s32(vmovl_s16(vld1_s16(x + j)));
+            vst1q_f32(dst + j, vmulq_f32(v, vscale));
+        }
+#elif defined(__SSE2__)
+        const __m128 vscale = _mm_set1_ps(scale);
+        for (; j + 4 <= n; j += 4) {
+            const __m128i s = _mm_loadl_epi64((const __m128i *) (x + j));
+            const __m128  v = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            _mm_storeu_ps(dst + j, _mm_mul_ps(v, vscale));
+        }
+#endif
+        for (; j < n; j++) {
+            dst[j] = float(x[j])*scale;
+        }
+    } else {
+        const int16_t * x = pcm.s16 + 2*offset;
+        const float scale = 1.0f/65536.0f;
+#if defined(__ARM_NEON)
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; j + 4 <= n; j += 4) {
+            const int16x4x2_t lr = vld2_s16(x + 2*j);
+            const float32x4_t v = vcvtq_f32_s32(vaddl_s16(lr.val[0], lr.val[1]));
+            vst1q_f32(dst + j, vmulq_f32(v, vscale));
+        }
+#elif defined(__SSE2__)
+        const __m128  vscale = _mm_set1_ps(scale);
+        const __m128i ones   = _mm_set1_epi16(1);
+        for (; j + 4 <= n; j += 4) {
+            // l + r of 4 frames as int32
+            const __m128i s = _mm_loadu_si128((const __m128i *) (x + 2*j));
+            const __m128  v = _mm_cvtepi32_ps(_mm_madd_epi16(s, ones));
+            _mm_storeu_ps(dst + j, _mm_mul_ps(v, vscale));
+        }
+#endif
+        for (; j < n; j++) {
+            dst[j] = float(x[2*j] + x[2*j + 1])*scale;
+        }
+    }
+
+    for (; j < n_read; j++) {
+        dst[j] = 0.0f;
+    }
+}
+
+// most channels whisper_wav_map_open() and the audio sources accept in a file
+#define WHISPER_MAX_CHANNELS 64
+
+// sample formats of interleaved PCM that whisper_downmix() converts to mono float
+enum whisper_sample_format {
+    WHISPER_SAMPLE_S16,
+    WHISPER_SAMPLE_S24, // packed little-endian, 3 bytes per sample
+    WHISPER_SAMPLE_S32,
+    WHISPER_SAMPLE_F32,
+};
+
+static inline int whisper_sample_size(whisper_sample_format format) {
+    switch (format) {
+        case WHISPER_SAMPLE_S16: return 2;
+        case WHISPER_SAMPLE_S24: return 3;
+        case WHISPER_SAMPLE_S32: return 4;
+        case WHISPER_SAMPLE_F32: return 4;
+    }
+    return 0;
+}
+
+// dst[j] = scale*sum_c x[j*n_channels + c] for n frames of interleaved float
+static void whisper_downmix_f32(const float * x, int n_channels, int n, float scale, float * dst) {
+    int j = 0;
+    if (n_channels == 1) {
+#if defined(__ARM_NEON)
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; j + 4 <= n; j += 4) {
+            vst1q_f32(dst + j, vmulq_f32(vld1q_f32(x + j), vscale));
+        }
+#elif defined(__SSE__)
+        const __m128 vscale = _mm_set1_ps(scale);
+        for (; j + 4 <= n; j += 4) {
+            _mm_storeu_ps(dst + j, _mm_mul_ps(_mm_loadu_ps(x + j), vscale));
+        }
+#endif
+        for (; j < n; j++) {
+            dst[j] = x[j]*scale;
+        }
+    } else if (n_channels == 2) {
+#if defined(__ARM_NEON)
+        const float32x4_t vscale = vdupq_n_f32(scale);
+        for (; j + 4 <= n; j += 4) {
+            const float32x4x2_t lr = vld2q_f32(x + 2*j);
+            vst1q_f32(dst + j, vmulq_f32(vaddq_f32(lr.val[0], lr.val[1]), vscale));
+        }
+#elif defined(__SSE__)
+        const __m128 vscale = _mm_set1_ps(scale);
+        for (; j + 4 <= n; j += 4) {
+            const __m128 a = _mm_loadu_ps(x + 2*j);
+            const __m128 b = _mm_loadu_ps(x + 2*j + 4);
+            const __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(dst + j, _mm_mul_ps(_mm_add_ps(l, r), vscale));
+        }
+#endif
+        for (; j < n; j++) {
+            dst[j] = (x[2*j] + x[2*j + 1])*scale;
+        }
+    } else {
+        for (; j < n; j++) {
+            const float * f = x + (size_t) j*n_channels;
+            float sum = 0.0f;
+            for (int c = 0; c < n_channels; c++) {
+                sum += f[c];
+            }
+            dst[j] = sum*scale;
+        }
+    }
+}
+
+// dst[j] = average of the n_channels samples of frame j, as float in [-1, 1) for integer formats
+// integer samples are widened to float in blocks (16 and 32-bit ones 4 at a time with NEON / SSE2)
+// before the channels are summed
+void whisper_downmix(const void * src, whisper_sample_format format, int n_channels, int n, float * dst) {
+    const float scale = 1.0f/n_channels;
+    if (format == WHISPER_SAMPLE_F32) {
+        whisper_downmix_f32((const float *) src, n_channels, n, scale, dst);
+        return;
+    }
+
+    const uint8_t * x = (const uint8_t *) src;
+    const int sample_size = whisper_sample_size(format);
+
+    // at least one frame per block: frames wider than the stack buffer go through a heap one
+    float stack_buf[2048];
+    std::vector<float> heap_buf;
+    float * buf = stack_buf;
+    int n_buf = (int) (sizeof(stack_buf)/sizeof(float));
+    if (n_channels > n_buf) {
+        heap_buf.resize(n_channels);
+        buf   = heap_buf.data();
+        n_buf = n_channels;
+    }
+    const int n_block = n_buf/n_channels;
+    for (int j0 = 0; j0 < n; j0 += n_block) {
+        const int n_frames  = std::min(n_block, n - j0);
+        const int n_samples = n_frames*n_channels;
+        const uint8_t * s = x + (size_t) j0*n_channels*sample_size;
+
+        int i = 0;
+        float in_scale = 1.0f;
+        if (format == WHISPER_SAMPLE_S16) {
+            const int16_t * v = (const int16_t *) s;
+            in_scale = 1.0f/32768.0f;
+#if defined(__ARM_NEON)
+            for (; i + 4 <= n_samples; i += 4) {
+                vst1q_f32(buf + i, vcvtq_f32_s32(vmovl_s16(vld1_s16(v + i))));
+            }
+#elif defined(__SSE2__)
+            for (; i + 4 <= n_samples; i += 4) {
+                const __m128i w = _mm_loadl_epi64((const __m128i *) (v + i));
+                _mm_storeu_ps(buf + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16)));
+            }
+#endif
+            for (; i < n_samples; i++) {
+                buf[i] = (float) v[i];
+            }
+        } else if (format == WHISPER_SAMPLE_S24) {
+            // the 3 bytes go to the top of an int32, the arithmetic shift restores the sign
+            in_scale = 1.0f/8388608.0f;
+            for (; i < n_samples; i++) {
+                const uint8_t * b = s + 3*i;
+                const int32_t v = (int32_t) ((uint32_t) b[0] << 8 | (uint32_t) b[1] << 16 | (uint32_t) b[2] << 24) >> 8;
+                buf[i] = (float) v;
+            }
+        } else {
+            const int32_t * v = (const int32_t *) s;
+            in_scale = 1.0f/2147483648.0f;
+#if defined(__ARM_NEON)
+            for (; i + 4 <= n_samples; i += 4) {
+                vst1q_f32(buf + i, vcvtq_f32_s32(vld1q_s32(v + i)));
+            }
+#elif defined(__SSE2__)
+            for (; i + 4 <= n_samples; i += 4) {
+                _mm_storeu_ps(buf + i, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) (v + i))));
+            }
+#endif
+            for (; i < n_samples; i++) {
+                buf[i] = (float) v[i];
+            }
+        }
+
+        whisper_downmix_f32(buf, n_channels, n_frames, scale*in_scale, dst + j0);
+    }
+}
+
+// WAV file mapped read-only, data points straight into its data chunk
+// nothing is read up front: pages are faulted in as frames are windowed, with
+// sequential read-ahead, and whisper_wav_map_drop() releases what was consumed
+struct whisper_wav_map {
+    std::shared_ptr<const uint8_t> mapping;
+    size_t size = 0;
+
+    // interleaved samples as stored in the file, see whisper_downmix()
+    const uint8_t * data = nullptr;
+    whisper_sample_format format = WHISPER_SAMPLE_S16;
+    int n_channels  = 0;
+    int sample_rate = 0;
+    int64_t n_frames = 0;
+
+    // set only when the frames can be windowed as they are: 16 kHz, 16-bit mono/stereo or float mono
+    whisper_pcm pcm;
+};
+
+static inline bool whisper_wav_map_direct(const whisper_wav_map & wav) {
+    return wav.pcm.f32 || wav.pcm.s16;
+}
+
+// maps a 16, 24 or 32-bit integer or 32-bit float PCM WAV file with any rate and up to
+// WHISPER_MAX_CHANNELS channels, false for anything else
+bool whisper_wav_map_open(const std::string & path, whisper_wav_map & wav) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const size_t size = st.st_size;
+    std::shared_ptr<const uint8_t> mapping((const uint8_t *) addr, [addr, size](const uint8_t *) {
+        munmap(addr, size);
+    });
+
+    // dr_wav only parses the chunk headers, the samples are never copied
+    drwav info;
+    if (!drwav_init_memory(&info, addr, size, nullptr)) {
+        return false;
+    }
+    const int n_channels  = info.channels;
+    const int bits        = info.bitsPerSample;
+    const int sample_rate = info.sampleRate;
+    const uint16_t tag    = info.translatedFormatTag;
+    const uint64_t data_pos = info.dataChunkDataPos;
+    const uint64_t total    = info.totalPCMFrameCount;
+    drwav_uninit(&info);
+
+    whisper_sample_format format;
+    if (tag == DR_WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+        format = WHISPER_SAMPLE_F32;
+    } else if (tag == DR_WAVE_FORMAT_PCM && bits == 16) {
+        format = WHISPER_SAMPLE_S16;
+    } else if (tag == DR_WAVE_FORMAT_PCM && bits == 24) {
+        format = WHISPER_SAMPLE_S24;
+    } else if (tag == DR_WAVE_FORMAT_PCM && bits == 32) {
+        format = WHISPER_SAMPLE_S32;
+    } else {
+        return false;
+    }
+    const int sample_size = whisper_sample_size(format);
+    if (n_channels <= 0 || n_channels > WHISPER_MAX_CHANNELS || sample_rate <= 0 ||
+        data_pos % (format == WHISPER_SAMPLE_S24 ? 1 : sample_size) != 0) {
+        return false;
+    }
+
+    const uint64_t n_avail  = (size - std::min<uint64_t>(size, data_pos))/(n_channels*sample_size);
+    const uint64_t n_frames = std::min<uint64_t>(total, n_avail);
+
+    const size_t page = getpagesize();
+    const size_t data_page = data_pos & ~(page - 1);
+    madvise((uint8_t *) addr + data_page, size - data_page, MADV_SEQUENTIAL);
+
+    wav.data        = (const uint8_t *) addr + data_pos;
+    wav.format      = format;
+    wav.n_channels  = n_channels;
+    wav.sample_rate = sample_rate;
+    wav.n_frames    = n_frames;
+    wav.pcm         = whisper_pcm();
+
+    if (sample_rate == WHISPER_SAMPLE_RATE && n_frames <= INT32_MAX) {
+        if (format == WHISPER_SAMPLE_F32 && n_channels == 1) {
+            wav.pcm = whisper_pcm_f32((const float *) wav.data, n_frames);
+        } else if (format == WHISPER_SAMPLE_S16 && (n_channels == 1 || n_channels == 2)) {
+            wav.pcm = whisper_pcm_s16((const int16_t *) wav.data, n_frames, n_channels);
+        }
+    }
+
+    wav.mapping = std::move(mapping);
+    wav.size    = size;
+
+    return true;
+}
+
+// drops the mapped pages holding frames before n_frames from the resident set,
+// they are read again from the file if touched later
+void whisper_wav_map_drop(const whisper_wav_map & wav, int64_t n_frames) {
+    const uint8_t * base = wav.mapping.get();
+    const size_t frame_size = (size_t) whisper_sample_size(wav.format)*wav.n_channels;
+    if (!base || n_frames <= 0) {
+        return;
+    }
+
+    const size_t page = getpagesize();
+    const size_t end  = std::min(wav.size, (size_t) (wav.data - base) + (size_t) n_frames*frame_size) & ~(page - 1);
+    if (end > 0) {
+        madvise((void *) base, end, MADV_DONTNEED);
+    }
+}
+
+// streaming polyphase resampler, mono float, windowed sinc
+// output sample j is taken at input time j*M/L (L/M = rate_out/rate_in reduced),
+// from the 2*half taps of phase (j*M mod L) of a Kaiser windowed sinc, so the
+// output is not delayed with respect to the input
+// the cutoff is rolloff times the lower of the two Nyquist frequencies; with
+// more than WHISPER_RESAMPLER_MAX_PHASES phases (odd rates) the nearest of
+// WHISPER_RESAMPLER_MAX_PHASES phases is used, equal rates are passed through
+#define WHISPER_RESAMPLER_MAX_PHASES 1024
+
+class whisper_resampler {
+public:
+    whisper_resampler(int rate_in, int rate_out = WHISPER_SAMPLE_RATE, int n_zeros = 16, float rolloff = 0.95f) {
+        const int g = std::gcd(rate_in, rate_out);
+        m_l = rate_out/g;
+        m_m = rate_in/g;
+
+        // cutoff in cycles per input sample, n_zeros zero crossings of the sinc on each side
+        const double fc = 0.5*std::min(1.0, (double) m_l/m_m)*rolloff;
+        // half is rounded up to even so that the 2*half taps are whole SIMD vectors in whisper_vec_dot_f32()
+        m_half  = ((int) std::ceil(n_zeros/(2.0*fc)) + 1) & ~1;
+        m_taps  = 2*m_half;
+        m_n_phases = std::min(m_l, WHISPER_RESAMPLER_MAX_PHASES);
+
+        // Kaiser window, beta 8.6: about -90 dB stop band
+        const double beta = 8.6;
+        auto bessel_i0 = [](double x) {
+            double sum = 1.0, term = 1.0;
+            for (int k = 1; k < 32; k++) {
+                term *= (x/(2*k))*(x/(2*k));
+                sum  += term;
+            }
+            return sum;
+        };
+        const double i0_beta = bessel_i0(beta);
+
+        // phase p, tap k weighs input sample i - half + 1 + k for an output at i + p/n_phases
+        m_coef.assign((size_t) m_n_phases*m_taps, 0.0f);
+        for (int p = 0; p < m_n_phases; p++) {
+            const double frac = (double) p/m_n_phases;
+            for (int k = 0; k < 2*m_half; k++) {
+                const double t = frac - (k - m_half + 1);
+                const double r = t/(m_half + 1);
+                const double w = std::fabs(r) < 1.0 ? bessel_i0(beta*std::sqrt(1.0 - r*r))/i0_beta : 0.0;
+                const double x = 2.0*M_PI*fc*t;
+                const double s = std::fabs(x) < 1e-9 ? 1.0 : std::sin(x)/x;
+                m_coef[(size_t) p*m_taps + k] = (float) (2.0*fc*s*w);
+            }
+        }
+
+        reset();
+    }
+
+    void reset() {
+        // the taps before the first sample see zeros
+        m_buf.assign(m_half - 1, 0.0f);
+        m_buf_start = -(m_half - 1);
+        m_n_in  = 0;
+        m_n_out = 0;
+        m_i     = 0;
+        m_num   = 0;
+    }
+
+    int rate_ratio_l() const { return m_l; }
+    int rate_ratio_m() const { return m_m; }
+
+    // output samples expected for n_in input samples
+    int64_t n_out(int64_t n_in) const {
+        return (n_in*m_l + m_m - 1)/m_m;
+    }
+
+    // input sample to seek to for output sample `sample`: the input and output grids meet every m
+    // input samples (l output samples), so after reset() the output from there on is the one of a
+    // continuous run once the taps are past the seek point. pos receives that output position,
+    // at most l - 1 samples before `sample`
+    int64_t seek_input(int64_t sample, int64_t & pos) const {
+        const int64_t k = std::max<int64_t>(0, sample)/m_l;
+        pos = k*m_l;
+        return k*m_m;
+    }
+
+    // consumes n input samples, appends the output samples they complete to out
+    void push(const float * x, int n, std::vector<float> & out) {
+        if (m_l == m_m) {
+            out.insert(out.end(), x, x + n);
+            return;
+        }
+        m_buf.insert(m_buf.end(), x, x + n);
+        m_n_in += n;
+        emit(m_n_in, out);
+    }
+
+    // end of input: the taps past the last sample see zeros
+    void flush(std::vector<float> & out) {
+        if (m_l == m_m) {
+            return;
+        }
+        m_buf.insert(m_buf.end(), m_half + 1, 0.0f);
+        emit(m_n_in + m_half + 1, out);
+    }
+
+private:
+    // emits the outputs whose taps all lie below input index n_avail (and within the input)
+    void emit(int64_t n_avail, std::vector<float> & out) {
+        const int64_t n_total = n_out(m_n_in);
+        const size_t o = out.size();
+        out.resize(o + std::max<int64_t>(0, std::min<int64_t>(n_total, (n_avail - m_half)*m_l/m_m + 2) - m_n_out));
+        size_t n = o;
+
+        while (m_n_out < n_total && m_i + m_half < n_avail && n < out.size()) {
+            int64_t i = m_i;
+            int p = m_n_phases == m_l ? m_num : (int) (((int64_t) m_num*m_n_phases + m_l/2)/m_l);
+            if (p == m_n_phases) {
+                p = 0;
+                i++;
+                if (i + m_half >= n_avail) {
+                    break;
+                }
+            }
+
+            const float * x = m_buf.data() + (i - m_half + 1 - m_buf_start);
+            out[n++] = whisper_vec_dot_f32(m_coef.data() + (size_t) p*m_taps, x, m_taps);
+            m_n_out++;
+
+            m_num += m_m;
+            m_i   += m_num/m_l;
+            m_num %= m_l;
+        }
+        out.resize(n);
+
+        // drop the input no output needs anymore, in large steps
+        const int64_t keep = m_i - m_half + 1;
+        if (keep - m_buf_start >= 4096) {
+            m_buf.erase(m_buf.begin(), m_buf.begin() + (keep - m_buf_start));
+            m_buf_start = keep;
+        }
+    }
+
+    int m_l = 1;
+    int m_m = 1;
+    int m_half = 1;
+    int m_taps = 4;
+    int m_n_phases = 1;
+    std::vector<float> m_coef; // [n_phases][taps], taps a multiple of 4
+
+    std::vector<float> m_buf;  // input from index m_buf_start on
+    int64_t m_buf_start = 0;
+    int64_t m_n_in  = 0;
+    int64_t m_n_out = 0;
+    int64_t m_i   = 0;         // next output at input time m_i + m_num/m_l
+    int     m_num = 0;
+};
+
+// fft_in[j] = hann[j]*x[offset + j], see whisper_pcm_read()
+// FFT_SIZE > 0 fixes the window length at compile time, see log_mel_spectrogram()
+template <int FFT_SIZE = 0>
+static inline void whisper_pcm_window(const whisper_pcm & pcm, int offset, const float * hann, int fft_size_rt, float * fft_in) {
+    const int fft_size = FFT_SIZE > 0 ? FFT_SIZE : fft_size_rt;
+
+    whisper_pcm_read(pcm, offset, fft_size, fft_in);
+    for (int j = 0; j < fft_size; j++) {
+        fft_in[j] *= hann[j];
+    }
+}
+
+// log10 mel energies of one frame
+// fft_in holds fft_size windowed samples, fft_out 2*(fft_size/2 + 1) floats
+// and out receives filters.n_mel values
+template <int FFT_SIZE = 0, int N_MEL = 0>
+static inline void whisper_mel_frame(
+        whisper_fft_backend & fft,
+        const whisper_filters & filters,
+        const int fft_size_rt,
+        const float * fft_in,
+        float * fft_out,
+        float * out) {
+    const int fft_size = FFT_SIZE > 0 ? FFT_SIZE : fft_size_rt;
+    const int n_mel    = N_MEL    > 0 ? N_MEL    : filters.n_mel;
+    const int n_fft    = 1 + fft_size/2;
+
+    // FFT -> mag^2
+    // bins mirrored above fft_size/2 are folded back, hence the factor 2
+    fft.forward(fft_in, fft_out);
+
+    for (int j = 0; j < n_fft; j++) {
+        fft_out[j] = (fft_out[2*j + 0]*fft_out[2*j + 0] + fft_out[2*j + 1]*fft_out[2*j + 1]);
+        if (j > 0 && j < fft_size/2) {
+            fft_out[j] *= 2.0f;
+        }
+    }
+
+    // mel spectrogram
+    whisper_filters_apply<N_MEL>(filters, fft_out, out);
+    whisper_vec_log10_f32(out, n_mel);
+}
+
+// how log_mel_spectrogram turns frames into power spectra
+// WHISPER_MEL_FFT transforms one frame at a time with the selected FFT backend,
+// WHISPER_MEL_GEMM multiplies a whole block of frames by a DFT basis
+enum whisper_mel_method {
+    WHISPER_MEL_FFT  = 0,
+    WHISPER_MEL_GEMM = 1,
+    WHISPER_MEL_COUNT,
+};
+
+static const char * whisper_mel_method_names[WHISPER_MEL_COUNT] = {
+    "fft",
+    "gemm",
+};
+
+std::atomic<int> g_whisper_mel_method{WHISPER_MEL_FFT};
+
+// select a method by name, returns false for unknown ones
+bool whisper_mel_method_select(const char * name) {
+    for (int i = 0; i < WHISPER_MEL_COUNT; i++) {
+        if (strcmp(name, whisper_mel_method_names[i]) == 0) {
+            g_whisper_mel_method = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> whisper_matrix;
+
+// real DFT of a Hann windowed frame as a [fft_size][2*n_fft] matrix
+// columns [0, n_fft) give the real parts, [n_fft, 2*n_fft) the imaginary ones,
+// the window and the factor 2 of the folded bins are baked into the weights
+struct whisper_dft_basis {
+    int fft_size = 0;
+    int n_fft    = 0;
+
+    whisper_matrix w;
+};
+
+// bases are built on first use and shared by all threads
+const whisper_dft_basis & whisper_dft_get_basis(int fft_size) {
+    static std::mutex mutex;
+    static std::map<int, std::unique_ptr<whisper_dft_basis>> bases;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto & basis = bases[fft_size];
+    if (!basis) {
+        const int n_fft = 1 + fft_size/2;
+
+        basis.reset(new whisper_dft_basis());
+        basis->fft_size = fft_size;
+        basis->n_fft    = n_fft;
+        basis->w.resize(fft_size, 2*n_fft);
+
+        for (int t = 0; t < fft_size; t++) {
+            const double hann = 0.5*(1.0 - cos((2.0*M_PI*t)/(fft_size)));
+            for (int k = 0; k < n_fft; k++) {
+                const double scale = (k > 0 && k < fft_size/2) ? sqrt(2.0) : 1.0;
+                // t*k mod fft_size keeps the angle small and the table exact
+                const double theta = (2.0*M_PI*((int64_t) t*k % fft_size))/fft_size;
+                basis->w(t, k)         = (float) ( scale*hann*cos(theta));
+                basis->w(t, n_fft + k) = (float) (-scale*hann*sin(theta));
+            }
+        }
+    }
+
+    return *basis;
+}
+
+// log10 mel energies of n_frames frames with two matrix products
+// x holds the samples of the block, frame i starting at x + i*fft_step, so the
+// frame matrix is a strided view and is never materialized
+// work needs n_frames*2*n_fft floats, out receives n_frames rows of n_mel values
+static void whisper_mel_frames_gemm(
+        const whisper_dft_basis & basis,
+        const whisper_filters & filters,
+        const float * x,
+        int n_frames,
+        int fft_step,
+        float * work,
+        float * out) {
+    const int n_fft = basis.n_fft;
+    const int n_mel = filters.n_mel;
+
+    Eigen::Map<const whisper_matrix, 0, Eigen::OuterStride<>> frames(x, n_frames, basis.fft_size, Eigen::OuterStride<>(fft_step));
+    Eigen::Map<whisper_matrix> spec(work, n_frames, 2*n_fft);
+
+    spec.noalias() = frames*basis.w;
+
+    // mag^2 in place of the real parts
+    spec.leftCols(n_fft) = spec.leftCols(n_fft).array().square() + spec.rightCols(n_fft).array().square();
+
+    // filters.data is [n_mel][n_fft] row-major, i.e. its transpose in column-major
+    Eigen::Map<const Eigen::MatrixXf> filters_t(filters.data.data(), n_fft, n_mel);
+    Eigen::Map<whisper_matrix> mels(out, n_frames, n_mel);
+
+    mels.noalias() = spec.leftCols(n_fft)*filters_t;
+
+    whisper_vec_log10_f32(out, n_frames*n_mel);
+}
+
+// the front end for one (fft_size, fft_step, n_mel) shape, a template argument
+// of 0 means the value is only known at run time
+template <int FFT_SIZE, int FFT_STEP, int N_MEL>
+static bool log_mel_spectrogram_impl(
+        const whisper_pcm & pcm,
+        const int fft_size_rt,
+        const int fft_step_rt,
+        const int n_mel_rt,
+        whisper_thread_pool & pool,
+        const whisper_filters & filters,
+        whisper_mel & mel,
+        whisper_mel_method method) {
+    const int fft_size = FFT_SIZE > 0 ? FFT_SIZE : fft_size_rt;
+    const int fft_step = FFT_STEP > 0 ? FFT_STEP : fft_step_rt;
+    const int n_mel    = N_MEL    > 0 ? N_MEL    : n_mel_rt;
+
+    // Hanning window
+    std::vector<float> hann;
+    hann.resize(fft_size);
+    for (int i = 0; i < fft_size; i++) {
+        hann[i] = 0.5*(1.0 - cos((2.0*M_PI*i)/(fft_size)));
+    }
+
+    mel.n_mel = n_mel;
+    mel.n_len = (pcm.n_samples)/fft_step;
+    mel.data.resize(mel.n_mel*mel.n_len);
+    mel.mapped.reset();
+
+    const int n_fft = 1 + fft_size/2;
+
+    //printf("%s: n_samples = %d, n_len = %d\n", __func__, pcm.n_samples, mel.n_len);
+    //printf("%s: recording length: %f s\n", __func__, (float) pcm.n_samples/WHISPER_SAMPLE_RATE);
+
+    const bool gemm = method == WHISPER_MEL_GEMM;
+
+    // frames per work item, keeps every chunk's writes to mel.data contiguous
+    // the matrix products want taller blocks than the per-frame path
+    const int n_chunk = gemm ? 128 : 32;
+
+    // per thread: one frame and its spectrum, or the samples of a block and its spectra
+    const int n_work = gemm ? (n_chunk - 1)*fft_step + fft_size + n_chunk*2*n_fft : fft_size + 2*n_fft;
+
+    std::vector<float> fft_work(pool.n_threads()*n_work);
+
+    const whisper_dft_basis * basis = gemm ? &whisper_dft_get_basis(fft_size) : nullptr;
+
+    // created by each thread on its first chunk
+    std::vector<std::unique_ptr<whisper_fft_backend>> fft(pool.n_threads());
+
+    // every thread keeps its own maximum, reduced once the frames are done
+    std::vector<float> thread_max(pool.n_threads(), -1e20f);
+
+    pool.parallel_for(mel.n_len, n_chunk, [&](int i0, int i1, int ith) {
+        float chunk_max = -1e20f;
+
+        if (gemm) {
+            const int n_samples = (i1 - i0 - 1)*fft_step + fft_size;
+
+            float * x    = fft_work.data() + ith*n_work;
+            float * spec = x + n_samples;
+            float * out  = mel.data.data() + i0*n_mel;
+
+            whisper_pcm_read(pcm, i0*fft_step, n_samples, x);
+            whisper_mel_frames_gemm(*basis, filters, x, i1 - i0, fft_step, spec, out);
+
+            thread_max[ith] = std::max(thread_max[ith], whisper_vec_max_f32(out, (i1 - i0)*n_mel));
+            return;
+        }
+
+        float * fft_in  = fft_work.data() + ith*n_work;
+        float * fft_out = fft_in + fft_size;
+
+        if (!fft[ith]) {
+            fft[ith] = whisper_fft_backend_create(fft_size);
+        }
+
+        for (int i = i0; i < i1; i++) {
+            // apply Hanning window
+            whisper_pcm_window<FFT_SIZE>(pcm, i*fft_step, hann.data(), fft_size, fft_in);
+
+            float * frame = mel.data.data() + i*n_mel;
+
+            whisper_mel_frame<FFT_SIZE, N_MEL>(*fft[ith], filters, fft_size, fft_in, fft_out, frame);
+
+            chunk_max = std::max(chunk_max, whisper_vec_max_f32(frame, n_mel));
+        }
+
+        thread_max[ith] = std::max(thread_max[ith], chunk_max);
+    });
+
+    // clamping and normalization are deferred to whisper_mel_get_window()
+    float mmax = -1e20f;
+    for (const float m : thread_max) {
+        mmax = std::max(mmax, m);
+    }
+    //printf("%s: max = %f\n", __func__, mmax);
+
+    mel.mmax = mmax;
+
+    return true;
+}
+
+// ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L92-L124
+// the 80 mel (tiny to large-v2) and 128 mel (large-v3) Whisper front ends are
+// instantiated with their shape known at compile time, any other shape takes
+// the generic path
+bool log_mel_spectrogram(
+        const whisper_pcm & pcm,
+        const int sample_rate,
+        const int fft_size,
+        const int fft_step,
+        const int n_mel,
+        whisper_thread_pool & pool,
+        const whisper_filters & filters,
+        whisper_mel & mel,
+        const whisper_mel_method method = (whisper_mel_method) g_whisper_mel_method.load()) {
+    // the filterbank and the models expect 16 kHz, the caller resamples
+    if (sample_rate != WHISPER_SAMPLE_RATE || filters.n_mel != n_mel || filters.n_fft != 1 + fft_size/2) {
+        return false;
+    }
+
+    if (fft_size == WHISPER_N_FFT && fft_step == WHISPER_HOP_LENGTH) {
+        switch (n_mel) {
+            case 80:
+                return log_mel_spectrogram_impl<WHISPER_N_FFT, WHISPER_HOP_LENGTH, 80>(
+                        pcm, fft_size, fft_step, n_mel, pool, filters, mel, method);
+            case 128:
+                return log_mel_spectrogram_impl<WHISPER_N_FFT, WHISPER_HOP_LENGTH, 128>(
+                        pcm, fft_size, fft_step, n_mel, pool, filters, mel, method);
+        }
+    }
+
+    return log_mel_spectrogram_impl<0, 0, 0>(pcm, fft_size, fft_step, n_mel, pool, filters, mel, method);
+}
+
+struct whisper_mel_bench_result {
+    whisper_mel_method method;
+    double ns_per_frame = 0.0;
+    double max_err = 0.0; // largest abs. difference of the log10 energies to the FFT method
+};
+
+// time the spectrogram of n_frames frames of noise with every method on a
+// single thread, the FFT method uses the selected backend
+std::vector<whisper_mel_bench_result> whisper_mel_benchmark(const whisper_filters & filters, int n_frames = 3000) {
+    const int fft_size = 2*(filters.n_fft - 1);
+
+    std::vector<float> samples((size_t) n_frames*WHISPER_HOP_LENGTH);
+    uint32_t seed = 12345;
+    for (auto & s : samples) {
+        seed = seed*1664525u + 1013904223u;
+        s = 0.1f*((float) (seed >> 8)/(1 << 23) - 1.0f);
+    }
+
+    whisper_thread_pool pool(1);
+    std::vector<whisper_mel_bench_result> results;
+    whisper_mel ref;
+
+    for (int i = 0; i < WHISPER_MEL_COUNT; i++) {
+        whisper_mel_bench_result res;
+        res.method = (whisper_mel_method) i;
+
+        whisper_mel out;
+
+        // warm-up, builds the plans and the DFT basis
+        log_mel_spectrogram(whisper_pcm_f32(samples.data(), samples.size()), WHISPER_SAMPLE_RATE, fft_size, WHISPER_HOP_LENGTH,
+                filters.n_mel, pool, filters, i == 0 ? ref : out, res.method);
+
+        const auto t0 = std::chrono::steady_clock::now();
+        log_mel_spectrogram(whisper_pcm_f32(samples.data(), samples.size()), WHISPER_SAMPLE_RATE, fft_size, WHISPER_HOP_LENGTH,
+                filters.n_mel, pool, filters, out, res.method);
+        const auto t1 = std::chrono::steady_clock::now();
+
+        res.ns_per_frame = std::chrono::duration<double, std::nano>(t1 - t0).count()/std::max(1, out.n_len);
+
+        for (size_t k = 0; k < out.data.size() && k < ref.data.size(); k++) {
+            res.max_err = std::max(res.max_err, (double) fabs(out.data[k] - ref.data[k]));
+        }
+
+        results.push_back(res);
+    }
+
+    return results;
+}
+
+// transpose frames [i0, i1) x mels [j0, j1) of a frame-major block into
+// rows of n_len floats, clamping to mmin and normalizing on the way
+// 4x4 blocks go through SIMD registers, the ragged edges are done in scalar
+static inline void whisper_mel_tile(
+        const float * src, int n_mel,
+        float * dst, int n_len,
+        int i0, int i1, int j0, int j1,
+        float mmin) {
+    int j = j0;
+
+#if defined(__ARM_NEON) || defined(__SSE__)
+    for (; j + 4 <= j1; j += 4) {
+        int i = i0;
+        for (; i + 4 <= i1; i += 4) {
+            const float * s = src + (size_t) i*n_mel + j;
+            float * d = dst + (size_t) j*n_len + i;
+#if defined(__ARM_NEON)
+            const float32x4_t vmin  = vdupq_n_f32(mmin);
+            const float32x4_t four  = vdupq_n_f32(4.0f);
+            const float32x4_t scale = vdupq_n_f32(0.25f);
+
+            const float32x4x2_t t01 = vtrnq_f32(vld1q_f32(s),           vld1q_f32(s + n_mel));
+            const float32x4x2_t t23 = vtrnq_f32(vld1q_f32(s + 2*n_mel), vld1q_f32(s + 3*n_mel));
+
+            float32x4_t c[4] = {
+                vcombine_f32(vget_low_f32(t01.val[0]),  vget_low_f32(t23.val[0])),
+                vcombine_f32(vget_low_f32(t01.val[1]),  vget_low_f32(t23.val[1])),
+                vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])),
+                vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])),
+            };
+            for (int k = 0; k < 4; k++) {
+                vst1q_f32(d + (size_t) k*n_len, vmulq_f32(vaddq_f32(vmaxq_f32(c[k], vmin), four), scale));
+            }
+#else
+            const __m128 vmin  = _mm_set1_ps(mmin);
+            const __m128 four  = _mm_set1_ps(4.0f);
+            const __m128 scale = _mm_set1_ps(0.25f);
+
+            __m128 c0 = _mm_loadu_ps(s);
+            __m128 c1 = _mm_loadu_ps(s + n_mel);
+            __m128 c2 = _mm_loadu_ps(s + 2*n_mel);
+            __m128 c3 = _mm_loadu_ps(s + 3*n_mel);
+            _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+            _mm_storeu_ps(d,           _mm_mul_ps(_mm_add_ps(_mm_max_ps(c0, vmin), four), scale));
+            _mm_storeu_ps(d + n_len,   _mm_mul_ps(_mm_add_ps(_mm_max_ps(c1, vmin), four), scale));
+            _mm_storeu_ps(d + 2*n_len, _mm_mul_ps(_mm_add_ps(_mm_max_ps(c2, vmin), four), scale));
+            _mm_storeu_ps(d + 3*n_len, _mm_mul_ps(_mm_add_ps(_mm_max_ps(c3, vmin), four), scale));
+#endif
+        }
+        for (; i < i1; i++) {
+            for (int k = j; k < j + 4; k++) {
+                dst[(size_t) k*n_len + i] = (std::max(src[(size_t) i*n_mel + k], mmin) + 4.0f)*0.25f;
+            }
+        }
+    }
+#endif
+
+    for (; j < j1; j++) {
+        float * row = dst + (size_t) j*n_len;
+        for (int i = i0; i < i1; i++) {
+            row[i] = (std::max(src[(size_t) i*n_mel + j], mmin) + 4.0f)*0.25f;
+        }
+    }
+}
+
+// write n_frames frames starting at frame offset in the [n_mel][stride] layout
+// the encoder expects, returns how many were available in the file
+// the transpose goes tile by tile so that both the frame-major reads and the
+// row-major writes stay within a few cache lines, clamping and normalization
+// happen on the way so every value is read and written exactly once
+static int whisper_mel_copy_frames(const whisper_mel & mel, int offset, int n_frames, int stride, float * dst) {
+    const int n_mel = mel.n_mel;
+    const int n_tile = 16;
+
+    const float mmin = mel.mmax - 8.0f;
+
+    const int n_avail = std::max(0, std::min(n_frames, mel.n_len - offset));
+    const float * src = mel.frames() + (size_t) offset*n_mel;
+
+    for (int i0 = 0; i0 < n_avail; i0 += n_tile) {
+        const int i1 = std::min(i0 + n_tile, n_avail);
+        for (int j0 = 0; j0 < n_mel; j0 += n_tile) {
+            whisper_mel_tile(src, n_mel, dst, stride, i0, i1, j0, std::min(j0 + n_tile, n_mel), mmin);
+        }
+    }
+
+    return n_avail;
+}
+
+// fill columns [i0, n_len) with the value zero-padded audio would get
+static void whisper_mel_pad_frames(const whisper_mel & mel, int i0, int n_len, float * dst) {
+    const float pad = (std::max(-10.0f, mel.mmax - 8.0f) + 4.0f)/4.0f;
+
+    for (int j = 0; j < mel.n_mel; j++) {
+        std::fill(dst + (size_t) j*n_len + i0, dst + (size_t) (j + 1)*n_len, pad);
+    }
+}
+
+// n_len frames starting at frame offset, frames past the end of the file are padded
+void whisper_mel_get_window(const whisper_mel & mel, int offset, int n_len, float * dst) {
+    const int n = whisper_mel_copy_frames(mel, offset, n_len, n_len, dst);
+    whisper_mel_pad_frames(mel, n, n_len, dst);
+}
+
+// number of encoder windows of WHISPER_MEL_LEN frames needed to cover the file
+int whisper_mel_n_windows(const whisper_mel & mel) {
+    return (mel.n_len + WHISPER_MEL_LEN - 1)/WHISPER_MEL_LEN;
+}
+
+// a range of frames of the whole-file spectrogram (and so of samples of the
+// PCM it was computed from), it owns nothing
+struct whisper_segment {
+    int offset = 0; // first frame
+    int n_len  = 0; // number of frames
+};
+
+// what is handed to the encoder: one or more segments of the file placed back
+// to back, at most WHISPER_MEL_LEN frames in total, the rest is padded when
+// the window is written
+struct whisper_window {
+    std::vector<whisper_segment> segments;
+
+    int n_len() const {
+        int n = 0;
+        for (const auto & seg : segments) n += seg.n_len;
+        return n;
+    }
+};
+
+// encoder input for a window, [n_mel][WHISPER_MEL_LEN]
+void whisper_mel_get_window(const whisper_mel & mel, const whisper_window & win, float * dst) {
+    int n = 0;
+    for (const auto & seg : win.segments) {
+        n += whisper_mel_copy_frames(mel, seg.offset, std::min(seg.n_len, WHISPER_MEL_LEN - n), WHISPER_MEL_LEN, dst + n);
+    }
+    whisper_mel_pad_frames(mel, n, WHISPER_MEL_LEN, dst);
+}
+
+// sum of squares and number of sign changes of x[0..n)
+static inline void whisper_vec_energy_zcr_f32(const float * x, int n, float & energy, int & n_zc) {
+    int i = 0;
+    float sum = 0.0f;
+    int zc = 0;
+
+#if defined(__ARM_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    uint32x4_t  cnt = vdupq_n_u32(0);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    for (; i + 5 <= n; i += 4) {
+        const float32x4_t a = vld1q_f32(x + i);
+        const float32x4_t b = vld1q_f32(x + i + 1);
+        acc = vmlaq_f32(acc, a, a);
+        // all ones where x[k]*x[k + 1] < 0, i.e. -1 per crossing
+        cnt = vsubq_u32(cnt, vcltq_f32(vmulq_f32(a, b), zero));
+    }
+    const float32x2_t acc2 = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    sum = vget_lane_f32(vpadd_f32(acc2, acc2), 0);
+    const uint32x2_t cnt2 = vadd_u32(vget_low_u32(cnt), vget_high_u32(cnt));
+    zc = vget_lane_u32(vpadd_u32(cnt2, cnt2), 0);
+#elif defined(__SSE2__)
+    __m128  acc = _mm_setzero_ps();
+    __m128i cnt = _mm_setzero_si128();
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 5 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(x + i);
+        const __m128 b = _mm_loadu_ps(x + i + 1);
+        acc = _mm_add_ps(acc, _mm_mul_ps(a, a));
+        cnt = _mm_sub_epi32(cnt, _mm_castps_si128(_mm_cmplt_ps(_mm_mul_ps(a, b), zero)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+    cnt = _mm_add_epi32(cnt, _mm_shuffle_epi32(cnt, _MM_SHUFFLE(1, 0, 3, 2)));
+    cnt = _mm_add_epi32(cnt, _mm_shuffle_epi32(cnt, _MM_SHUFFLE(2, 3, 0, 1)));
+    zc = _mm_cvtsi128_si32(cnt);
+#endif
+
+    for (; i < n; i++) {
+        sum += x[i]*x[i];
+        if (i + 1 < n && x[i]*x[i + 1] < 0.0f) {
+            zc++;
+        }
+    }
+
+    energy = sum;
+    n_zc = zc;
+}
+
+struct whisper_vad_params {
+    int   frame_len    = 2*WHISPER_HOP_LENGTH; // 20 ms, two mel frames
+    float energy_thold = -50.0f; // dBFS, frames below are never speech
+    float noise_margin = 10.0f;  // dB above the estimated noise floor
+    float noise_cap    = 10.0f;  // dB, the adaptive threshold never rises more above energy_thold
+    float zcr_thold    = 0.25f;  // crossings per sample of unvoiced speech
+    float zcr_margin   = 6.0f;   // dB below the threshold still accepted for high zcr frames
+    int   hangover     = 15;     // frames kept as speech after the last speech frame
+    int   onset        = 5;      // frames marked as speech before the first one
+};
+
+// per-frame speech decision for the whole file
+struct whisper_vad {
+    int frame_len = 0;
+    float thold   = 0.0f; // dBFS, the effective energy threshold
+    std::vector<uint8_t> speech;
+    std::vector<float>   energy; // dBFS
+
+    int n_speech() const {
+        int n = 0;
+        for (const uint8_t s : speech) n += s;
+        return n;
+    }
+};
+
+// energy and zero-crossing rate voice activity detection
+// the threshold adapts to the recording: the 10th percentile of the frame
+// energies is taken as the noise floor, quiet frames that cross zero often are
+// kept as unvoiced speech, and the decision is held for a while around every
+// speech frame so that word onsets and endings are not cut
+// in continuous speech the 10th percentile is speech, not noise: the adaptive
+// threshold is capped at noise_cap above energy_thold so that a quiet speaker
+// next to a loud one is still heard
+void whisper_vad_detect(const whisper_pcm & pcm, const whisper_vad_params & params, whisper_thread_pool & pool, whisper_vad & vad) {
+    const int frame_len = params.frame_len;
+    const int n_frames  = (pcm.n_samples + frame_len - 1)/frame_len;
+
+    vad.frame_len = frame_len;
+    vad.speech.assign(n_frames, 0);
+    vad.energy.resize(n_frames);
+
+    std::vector<float> & energy = vad.energy;
+    std::vector<float> zcr(n_frames);
+
+    std::vector<float> work(pool.n_threads()*frame_len);
+
+    pool.parallel_for(n_frames, 256, [&](int i0, int i1, int ith) {
+        float * x = work.data() + ith*frame_len;
+        for (int i = i0; i < i1; i++) {
+            const int n = std::min(frame_len, pcm.n_samples - i*frame_len);
+            whisper_pcm_read(pcm, i*frame_len, n, x);
+
+            float e;
+            int n_zc;
+            whisper_vec_energy_zcr_f32(x, n, e, n_zc);
+
+            energy[i] = 10.0f*log10f(e/n + 1e-10f);
+            zcr[i]    = float(n_zc)/n;
+        }
+    });
+
+    if (n_frames == 0) {
+        vad.thold = params.energy_thold;
+        return;
+    }
+
+    std::vector<float> sorted(energy);
+    std::nth_element(sorted.begin(), sorted.begin() + n_frames/10, sorted.end());
+    const float noise = sorted[n_frames/10];
+
+    vad.thold = std::max(params.energy_thold, std::min(noise + params.noise_margin, params.energy_thold + params.noise_cap));
+
+    int last = -1;
+    for (int i = 0; i < n_frames; i++) {
+        const bool voiced   = energy[i] > vad.thold;
+        const bool unvoiced = energy[i] > vad.thold - params.zcr_margin && zcr[i] > params.zcr_thold;
+        if (voiced || unvoiced) {
+            for (int k = std::max(last + 1, i - params.onset); k <= i; k++) {
+                vad.speech[k] = 1;
+            }
+            last = i;
+        } else if (last >= 0 && i - last <= params.hangover) {
+            vad.speech[i] = 1;
+        }
+    }
+}
+
+struct whisper_pack_params {
+    int max_gap   = 100; // frames, shorter pauses between islands are kept in the window
+    int max_split = 500; // frames, how far back from the window end a long island may be cut
+};
+
+// group the speech islands found by the VAD into encoder windows
+// islands are taken in order and packed greedily, a window is closed when the
+// next island does not fit; the silence between islands of the same window is
+// dropped unless the pause is short enough to keep the speech natural
+// islands longer than a window are cut at their quietest frame near the end
+// of the window, so that words are split only where the speaker pauses
+void whisper_vad_pack(const whisper_vad & vad, const whisper_mel & mel, const whisper_pack_params & params,
+        std::vector<whisper_window> & windows, int fft_step = WHISPER_HOP_LENGTH) {
+    windows.clear();
+
+    const int r = vad.frame_len/fft_step; // mel frames per VAD frame
+    const int n_vad = vad.speech.size();
+
+    // speech islands in mel frames, long ones already cut to fit a window
+    std::vector<whisper_segment> islands;
+    for (int i = 0; i < n_vad; ) {
+        if (!vad.speech[i]) {
+            i++;
+            continue;
+        }
+
+        int i1 = i;
+        while (i1 < n_vad && vad.speech[i1]) i1++;
+
+        while (i < i1) {
+            int end = i1;
+            if ((end - i)*r > WHISPER_MEL_LEN) {
+                // quietest frame in the last max_split frames of a full window
+                const int e1 = i + WHISPER_MEL_LEN/r;
+                const int e0 = std::max(i + 1, e1 - params.max_split/r);
+                end = e1;
+                for (int k = e0; k < e1; k++) {
+                    if (vad.energy[k] < vad.energy[end - 1]) {
+                        end = k + 1;
+                    }
+                }
+            }
+
+            whisper_segment seg;
+            seg.offset = i*r;
+            seg.n_len  = std::min(end*r, mel.n_len) - seg.offset;
+            if (seg.n_len > 0) {
+                islands.push_back(seg);
+            }
+            i = end;
+        }
+    }
+
+    int n_len = 0;
+    for (const auto & island : islands) {
+        whisper_segment * last = windows.empty() || windows.back().segments.empty() ? nullptr : &windows.back().segments.back();
+
+        const int gap = last ? island.offset - (last->offset + last->n_len) : 0;
+
+        if (last && gap <= params.max_gap && n_len + gap + island.n_len <= WHISPER_MEL_LEN) {
+            // short pause, keep it
+            last->n_len += gap + island.n_len;
+            n_len += gap + island.n_len;
+        } else if (last && n_len + island.n_len <= WHISPER_MEL_LEN) {
+            windows.back().segments.push_back(island);
+            n_len += island.n_len;
+        } else {
+            windows.emplace_back();
+            windows.back().segments.push_back(island);
+            n_len = island.n_len;
+        }
+    }
+}
+
+// on-disk cache of whole-file spectrograms
+// a file holds a whisper_mel_cache_header followed by the n_len*n_mel raw log10
+// values, frame-major as in whisper_mel, so that it can be mapped and used in place
+// the key hashes the 16 kHz PCM together with everything that shapes the
+// spectrogram (fft size, hop, filterbank), so a run with another model that
+// shares the filterbank finds the entry, and one with a different filterbank does not
+
+#define WHISPER_MEL_CACHE_MAGIC   0x4c454d57 // "WMEL"
+#define WHISPER_MEL_CACHE_VERSION 1
+#define WHISPER_MEL_CACHE_MAX_ENTRIES 8
+
+struct whisper_mel_cache_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    int32_t  n_mel;
+    int32_t  n_len;
+    float    mmax;
+    int32_t  reserved; // keeps the frames 8-byte aligned
+};
+
+uint64_t whisper_mel_cache_key(const whisper_pcm & pcm, int fft_size, int fft_step, const whisper_filters & filters) {
+    const int32_t params[] = {
+        WHISPER_MEL_CACHE_VERSION, fft_size, fft_step, filters.n_mel, filters.n_fft, pcm.n_channels, pcm.f32 ? 32 : 16,
+    };
+
+    uint64_t seed = util::Hash64((const char *) params, sizeof(params));
+    seed = util::Hash64WithSeed((const char *) filters.data.data(), filters.data.size()*sizeof(float), seed);
+
+    if (pcm.f32) {
+        return util::Hash64WithSeed((const char *) pcm.f32, (size_t) pcm.n_samples*sizeof(float), seed);
+    }
+    return util::Hash64WithSeed((const char *) pcm.s16, (size_t) pcm.n_samples*pcm.n_channels*sizeof(int16_t), seed);
+}
+
+std::string whisper_mel_cache_path(const std::string & dir, uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "mel-%016llx.bin", (unsigned long long) key);
+    return dir + "/" + name;
+}
+
+// map a cached spectrogram, false if there is no valid entry for the key
+bool whisper_mel_cache_load(const std::string & path, uint64_t key, whisper_mel & mel) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(whisper_mel_cache_header)) {
+        close(fd);
+        return false;
+    }
+
+    void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    const size_t size = st.st_size;
+    const auto * hdr = (const whisper_mel_cache_header *) addr;
+    if (hdr->magic != WHISPER_MEL_CACHE_MAGIC || hdr->version != WHISPER_MEL_CACHE_VERSION || hdr->key != key ||
+        hdr->n_mel <= 0 || hdr->n_len < 0 ||
+        size != sizeof(whisper_mel_cache_header) + (size_t) hdr->n_mel*hdr->n_len*sizeof(float)) {
+        munmap(addr, size);
+        return false;
+    }
+
+    mel.n_mel = hdr->n_mel;
+    mel.n_len = hdr->n_len;
+    mel.mmax  = hdr->mmax;
+    mel.data.clear();
+    mel.data.shrink_to_fit();
+    mel.mapped = std::shared_ptr<const float>((const float *) (hdr + 1), [addr, size](const float *) {
+        munmap(addr, size);
+    });
+
+    return true;
+}
+
+// write the spectrogram under a temporary name and rename it into place, so a
+// concurrent or interrupted run never sees a partial entry
+bool whisper_mel_cache_store(const std::string & path, uint64_t key, const whisper_mel & mel) {
+    whisper_mel_cache_header hdr = {};
+    hdr.magic   = WHISPER_MEL_CACHE_MAGIC;
+    hdr.version = WHISPER_MEL_CACHE_VERSION;
+    hdr.key     = key;
+    hdr.n_mel   = mel.n_mel;
+    hdr.n_len   = mel.n_len;
+    hdr.mmax    = mel.mmax;
+
+    const std::string tmp = path + ".tmp";
+
+    FILE * f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    const size_t n = (size_t) mel.n_mel*mel.n_len;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+    ok = ok && fwrite(mel.frames(), sizeof(float), n, f) == n;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// keep only the max_entries most recently written entries of the cache directory
+void whisper_mel_cache_trim(const std::string & dir, int max_entries) {
+    DIR * d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+
+    std::vector<std::pair<time_t, std::string>> entries;
+    while (const struct dirent * e = readdir(d)) {
+        const std::string name = e->d_name;
+        if (name.size() != 24 || name.compare(0, 4, "mel-") != 0 || name.compare(20, 4, ".bin") != 0) {
+            continue;
+        }
+
+        struct stat st;
+        const std::string path = dir + "/" + name;
+        if (stat(path.c_str(), &st) == 0) {
+            entries.emplace_back(st.st_mtime, path);
+        }
+    }
+    closedir(d);
+
+    if ((int) entries.size() <= max_entries) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end());
+    for (size_t i = 0; i + max_entries < entries.size(); i++) {
+        unlink(entries[i].second.c_str());
+    }
+}
+
+// incremental log mel spectrogram for audio that arrives in pieces
+// push() accepts any number of samples and emits only the frames that became
+// computable, the last fft_size samples are kept in a ring buffer so that
+// consecutive frames share their fft_size - fft_step overlap
+// the file-wide maximum used for clamping is not known in advance, so frames
+// are clamped against the running maximum of the last max_len frames
+class whisper_mel_stream {
+public:
+    whisper_mel_stream(
+            const whisper_filters & filters,
+            int fft_size = WHISPER_N_FFT,
+            int fft_step = WHISPER_HOP_LENGTH,
+            int max_len  = WHISPER_MEL_LEN)
+        : m_filters(filters),
+          m_fft(whisper_fft_backend_create(fft_size)),
+          m_fft_size(fft_size),
+          m_fft_step(fft_step),
+          m_max_len(std::max(1, max_len)) {
+        m_hann.resize(fft_size);
+        for (int i = 0; i < fft_size; i++) {
+            m_hann[i] = 0.5*(1.0 - cos((2.0*M_PI*i)/(fft_size)));
+        }
+        m_ring.resize(fft_size);
+        m_fft_in.resize(fft_size);
+        m_fft_out.resize(2*(1 + fft_size/2));
+        reset();
+    }
+
+    void reset() {
+        std::fill(m_ring.begin(), m_ring.end(), 0.0f);
+        m_n_samples = 0;
+        m_n_frames  = 0;
+        m_frame_max.clear();
+    }
+
+    int n_mel() const {
+        return m_filters.n_mel;
+    }
+
+    // frames emitted so far, frame i starts at sample i*fft_step
+    int64_t n_frames() const {
+        return m_n_frames;
+    }
+
+    // normalized value of a frame of silence given the current running maximum,
+    // what whisper_mel_get_window() pads with
+    float pad_value() const {
+        const float mmax = m_frame_max.empty() ? -1e20f : m_frame_max.front().second;
+        return (std::max(-10.0f, mmax - 8.0f) + 4.0f)/4.0f;
+    }
+
+    // appends the normalized new frames to out (frame-major), returns their count
+    int push(const float * samples, int n_samples, std::vector<float> & out) {
+        const int fft_size = m_fft_size;
+
+        int n_out = 0;
+        while (n_samples > 0) {
+            // samples still missing before the next frame is complete
+            const int64_t frame_end = m_n_frames*m_fft_step + fft_size;
+            const int n = (int) std::min<int64_t>(n_samples, frame_end - m_n_samples);
+
+            for (int i = 0; i < n; i++) {
+                m_ring[(m_n_samples + i)%fft_size] = samples[i];
+            }
+            samples   += n;
+            n_samples -= n;
+            m_n_samples += n;
+
+            if (m_n_samples == frame_end) {
+                emit(out, 0);
+                n_out++;
+            }
+        }
+
+        return n_out;
+    }
+
+    // end of input: emits the frames that run past the last sample with the
+    // missing samples taken as zeros, same frame count as log_mel_spectrogram
+    int flush(std::vector<float> & out) {
+        int n_out = 0;
+        while (m_n_frames < m_n_samples/m_fft_step) {
+            const int64_t frame_end = m_n_frames*m_fft_step + m_fft_size;
+            emit(out, (int) (frame_end - m_n_samples));
+            n_out++;
+        }
+
+        return n_out;
+    }
+
+private:
+    // windows the frame ending n_missing samples after the newest sample
+    void emit(std::vector<float> & out, int n_missing) {
+        const int fft_size = m_fft_size;
+        const int n_mel    = m_filters.n_mel;
+
+        const int n_avail = fft_size - n_missing;
+        const int64_t frame_begin = m_n_frames*m_fft_step;
+        for (int j = 0; j < n_avail; j++) {
+            m_fft_in[j] = m_hann[j]*m_ring[(frame_begin + j)%fft_size];
+        }
+        for (int j = n_avail; j < fft_size; j++) {
+            m_fft_in[j] = 0.0f;
+        }
+
+        const size_t o = out.size();
+        out.resize(o + n_mel);
+        float * frame = out.data() + o;
+
+        whisper_mel_frame(*m_fft, m_filters, fft_size, m_fft_in.data(), m_fft_out.data(), frame);
+
+        // monotonic queue of the frame maxima over the last m_max_len frames
+        const float fmax = whisper_vec_max_f32(frame, n_mel);
+        while (!m_frame_max.empty() && m_frame_max.back().second <= fmax) {
+            m_frame_max.pop_back();
+        }
+        m_frame_max.emplace_back(m_n_frames, fmax);
+        while (m_frame_max.front().first <= m_n_frames - m_max_len) {
+            m_frame_max.pop_front();
+        }
+
+        const float mmin = m_frame_max.front().second - 8.0f;
+        for (int j = 0; j < n_mel; j++) {
+            frame[j] = (std::max(frame[j], mmin) + 4.0f)/4.0f;
+        }
+
+        m_n_frames++;
+    }
+
+    const whisper_filters & m_filters;
+    std::unique_ptr<whisper_fft_backend> m_fft;
+
+    const int m_fft_size;
+    const int m_fft_step;
+    const int m_max_len;
+
+    std::vector<float> m_hann;
+    std::vector<float> m_ring; // last fft_size samples, sample t at t%fft_size
+
+    std::vector<float> m_fft_in;
+    std::vector<float> m_fft_out;
+
+    int64_t m_n_samples = 0;
+    int64_t m_n_frames  = 0;
+
+    std::deque<std::pair<int64_t, float>> m_frame_max;
+};
@@ -43,7 +43,6 @@ class MainActivity : AppCompatActivity() {
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
         setContentView(R.layout.activity_main)
-        val outputDir = applicationContext.filesDir
         myProgressBar = findViewById(R.id.loader)
         transcriptionText = findViewById(R.id.resultTextView)
         header = findViewById(R.id.header)
@@ -57,19 +56,10 @@ class MainActivity : AppCompatActivity() {
                     // Load the audio file at audioUri
                     // Supposons que vous avez l'URI du fichier d'entrée dans une variable appelée "inputUri"
                     val inputFilePath = getPathFromUri(this,it)
-                    val inputFile = File(inputFilePath!!)
-
-                    // Extraire le nom du fichier sans l'extension
-                    val fileNameWithoutExtension =
-                        inputFile.name.replaceFirst("[.][^.]+$".toRegex(), "")
-                    // Construct a new file in the private files directory.
-                    val outputFile: File = File(outputDir, "$fileNameWithoutExtension.wav")
-                    Log.d("MainActivity", "Loading audio file and convert to 16kHz wav")
-                    val returnCode = (applicationContext as MyApplication).convertTo16kHz(inputFilePath, outputFile.absolutePath)
-                    Log.d("MainActivity", "Conversion finished")
-                    if (returnCode == 0) {
+                    // Le fichier est décodé et rééchantillonné en mémoire par le worker, sans WAV intermédiaire
+                    if (inputFilePath != null) {
                         val data = Data.Builder()
-                            .putString("audioFilePath", outputFile.absolutePath)
+                            .putString("audioFilePath", inputFilePath)
                             .build()
 
                         val workRequest = OneTimeWorkRequestBuilder<TranscriptionWorker>()
@@ -102,7 +92,7 @@ class MainActivity : AppCompatActivity() {
 
                         WorkManager.getInstance(this).enqueue(workRequest)
                     } else {
-                        Log.d("Erreur de conversion", "Erreur de conversion")
+                        Log.d("MainActivity", "Impossible de trouver le chemin du fichier")
                     }
 
                 }
@@ -30,18 +30,102 @@ class MyApplication : Application() {
         notificationManager.createNotificationChannel(channel)
     }
 
-    external fun convertTo16kHz(inputFilePath: String?, outputFilePath: String?): Int
+    /**
+     * Decodes any audio file and writes it as a 16 kHz mono WAV, 16-bit PCM or,
+     * with floatOutput, 32-bit IEEE float. Returns 0 on success.
+     */
+    external fun convertTo16kHz(inputFilePath: String?, outputFilePath: String?, floatOutput: Boolean): Int
 
     /**
      * A native method that is implemented by the 'native-lib' native library,
      * which is packaged with this application.
      */
     // Load model by TF Lite C++ API
+    // cacheDir: directory for the on-disk mel spectrogram cache, null to disable it
+    // Any 16/24/32-bit PCM or float WAV is accepted, other rates and channel counts are
+    // resampled in memory
     external fun loadModelJNI(
         assetManager: AssetManager,
         fileName: String,
+        cacheDir: String?,
+        callback: JNIProgressCallback
+    ): String?
+
+    /**
+     * Decodes and resamples any audio file FFmpeg can read straight into memory
+     * and transcribes it, without writing an intermediate 16 kHz WAV.
+     * cacheDir: directory for the on-disk mel spectrogram cache, null to disable it
+     */
+    external fun transcribeFileJNI(
+        assetManager: AssetManager,
+        inputFilePath: String,
+        cacheDir: String?,
+        callback: JNIProgressCallback
+    ): String?
+
+    /**
+     * Same as [transcribeFileJNI] but decoding, the mel spectrogram and the encoder run
+     * concurrently: the first window is transcribed while the rest of the file is still
+     * being decoded. Windows without speech are skipped, no spectrogram cache and no
+     * packing of speech islands across windows.
+     *
+     * The mel input is not the same as [transcribeFileJNI]'s for the same audio: Whisper's
+     * front end clamps every value to 8 below the maximum of the whole file, which is not
+     * known before the end of a stream, so each window is clamped against the running
+     * maximum of the audio seen so far instead. Opt-in, see TranscriptionWorker.KEY_STREAMING.
+     */
+    external fun transcribeStreamJNI(
+        assetManager: AssetManager,
+        inputFilePath: String,
+        callback: JNIProgressCallback
+    ): String?
+
+    /**
+     * Same as [transcribeStreamJNI] for the part [startMs, endMs) of the file only,
+     * endMs < 0 meaning up to the end. The decoder seeks close to startMs instead of
+     * decoding everything before it and only the encoder windows covering the range run.
+     */
+    external fun transcribeRangeJNI(
+        assetManager: AssetManager,
+        inputFilePath: String,
+        startMs: Long,
+        endMs: Long,
         callback: JNIProgressCallback
     ): String?
 
     external fun freeModelJNI(): Int
+
+    /**
+     * Selects the FFT used by the mel front end: "builtin", "avtx", "eigen",
+     * or "auto" to benchmark them and keep the fastest on this CPU.
+     */
+    external fun setFftBackendJNI(backendName: String): Boolean
+
+    /**
+     * Selects how the mel front end computes spectra: "fft" (one frame at a
+     * time with the selected FFT backend) or "gemm" (blocks of frames times a
+     * DFT basis matrix).
+     */
+    external fun setMelMethodJNI(methodName: String): Boolean
+
+    /**
+     * Times every FFT backend on this CPU, one line per backend in ns/frame,
+     * followed by both mel methods once the model filters are loaded.
+     */
+    external fun benchmarkFftJNI(): String
+
+    /**
+     * Decodes [inputFilePath] to 16 kHz mono with each decoder that accepts it
+     * (dr_mp3, dr_wav, FFmpeg), one line per decoder with the delay before the
+     * first block and the throughput in samples per second.
+     */
+    external fun benchmarkDecodeJNI(inputFilePath: String): String
+
+    /**
+     * Resamples 10 s of synthetic audio to 16 kHz mono for 8/22.05/44.1/48 kHz
+     * inputs in several channel counts and sample formats, with the built-in
+     * resampler and with swr_convert: throughput and SNR of each, one line per
+     * configuration.
+     */
+    external fun benchmarkResamplerJNI(): String
 }
\ No newline at end of file
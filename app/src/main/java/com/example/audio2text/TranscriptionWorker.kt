@@ -9,6 +9,7 @@ import androidx.work.Data
 import androidx.work.ForegroundInfo
 import androidx.work.WorkerParameters
 import androidx.work.workDataOf
+import java.io.File
 
 class TranscriptionWorker(context: Context, workerParams: WorkerParameters) : CoroutineWorker(context, workerParams) {
     private val notificationManager =
@@ -27,9 +28,10 @@ class TranscriptionWorker(context: Context, workerParams: WorkerParameters) : Co
         setForeground(foregroundInfo)
 
         val audioFilePath = inputData.getString("audioFilePath")
+        val streaming = inputData.getBoolean(KEY_STREAMING, false)
 
         // Start transcription
-        val transcription = startTranscription(audioFilePath)
+        val transcription = startTranscription(audioFilePath, streaming)
 
         val outputData = Data.Builder()
             .putString("transcription", transcription)
@@ -38,7 +40,7 @@ class TranscriptionWorker(context: Context, workerParams: WorkerParameters) : Co
         return Result.success(outputData)
     }
 
-    private suspend fun startTranscription(filePath : String?) : String? {
+    private suspend fun startTranscription(filePath : String?, streaming: Boolean) : String? {
         // Call your JNI function here and update the notification with the progress
 
         val totalProgress = 100
@@ -55,10 +57,17 @@ class TranscriptionWorker(context: Context, workerParams: WorkerParameters) : Co
             }
         }
 
-        // Call the JNI function
+        // Call the JNI function. By default the whole-file path: spectrogram cache, speech islands
+        // packed into windows and whole-file normalization. The pipelined path starts faster on long
+        // files but normalizes each window on its own (see transcribeStreamJNI)
+        val app = applicationContext as MyApplication
         val transcription = filePath?.let {
-            (applicationContext as MyApplication).loadModelJNI(applicationContext.assets,
-                it, progressCallback)
+            if (streaming) {
+                app.transcribeStreamJNI(applicationContext.assets, it, progressCallback)
+            } else {
+                val melCacheDir = File(applicationContext.cacheDir, "mel").apply { mkdirs() }
+                app.transcribeFileJNI(applicationContext.assets, it, melCacheDir.absolutePath, progressCallback)
+            }
         }
 
         return transcription?.replace(Regex("\\[.*?\\]"), "")
@@ -78,6 +87,8 @@ class TranscriptionWorker(context: Context, workerParams: WorkerParameters) : Co
 
     companion object {
         const val NOTIFICATION_ID = 1
+        // Input data flag: use the pipelined transcribeStreamJNI instead of the cached whole-file path
+        const val KEY_STREAMING = "streaming"
         const val CHANNEL_ID = "transcription_channel"
     }
 }
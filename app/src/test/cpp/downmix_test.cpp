@@ -0,0 +1,110 @@
+// whisper_downmix against a plain scalar average, for every integer format and channel
+// counts from mono up to frames wider than its stack buffer, and the channel limit of
+// whisper_wav_map_open
+
+#include "host_stubs.h"
+#include "whisper.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <random>
+
+namespace {
+
+// interleaved samples of n frames in the file layout of format, with their value as float in [-1, 1)
+std::vector<uint8_t> make_pcm(whisper_sample_format format, int n_channels, int n, std::vector<float> & ref) {
+    std::mt19937 rng(n_channels);
+    std::uniform_int_distribution<int32_t> dist(INT32_MIN, INT32_MAX);
+    const int sample_size = whisper_sample_size(format);
+    std::vector<uint8_t> data((size_t) n*n_channels*sample_size);
+    ref.assign(n, 0.0f);
+    for (int j = 0; j < n; j++) {
+        double sum = 0.0;
+        for (int c = 0; c < n_channels; c++) {
+            const int32_t v = dist(rng);
+            uint8_t * p = data.data() + ((size_t) j*n_channels + c)*sample_size;
+            if (format == WHISPER_SAMPLE_S16) {
+                const int16_t s = (int16_t) (v >> 16);
+                memcpy(p, &s, 2);
+                sum += s/32768.0;
+            } else if (format == WHISPER_SAMPLE_S24) {
+                const int32_t s = v >> 8;
+                p[0] = (uint8_t) s;
+                p[1] = (uint8_t) (s >> 8);
+                p[2] = (uint8_t) (s >> 16);
+                sum += s/8388608.0;
+            } else if (format == WHISPER_SAMPLE_S32) {
+                memcpy(p, &v, 4);
+                sum += v/2147483648.0;
+            } else {
+                const float s = (float) (v/2147483648.0);
+                memcpy(p, &s, 4);
+                sum += s;
+            }
+        }
+        ref[j] = (float) (sum/n_channels);
+    }
+    return data;
+}
+
+void expect_downmix(whisper_sample_format format, int n_channels, int n) {
+    std::vector<float> ref;
+    const std::vector<uint8_t> data = make_pcm(format, n_channels, n, ref);
+    std::vector<float> out(n, NAN);
+    whisper_downmix(data.data(), format, n_channels, n, out.data());
+    for (int j = 0; j < n; j++) {
+        ASSERT_NEAR(out[j], ref[j], 1e-5f) << "format " << format << ", " << n_channels << " channels, frame " << j;
+    }
+}
+
+// minimal 16-bit PCM WAV with n_channels channels of silence
+std::string write_wav(int n_channels, int n) {
+    const std::string path = testing::TempDir() + "downmix_test_" + std::to_string(n_channels) + ".wav";
+    FILE * f = fopen(path.c_str(), "wb");
+    const uint32_t data_size = (uint32_t) n*n_channels*2;
+    const uint32_t riff_size = 36 + data_size;
+    const uint32_t fmt_size = 16, rate = 16000, byte_rate = rate*n_channels*2;
+    const uint16_t tag = 1, channels = (uint16_t) n_channels, block = (uint16_t) (n_channels*2), bits = 16;
+    fwrite("RIFF", 1, 4, f); fwrite(&riff_size, 4, 1, f); fwrite("WAVE", 1, 4, f);
+    fwrite("fmt ", 1, 4, f); fwrite(&fmt_size, 4, 1, f);
+    fwrite(&tag, 2, 1, f); fwrite(&channels, 2, 1, f); fwrite(&rate, 4, 1, f);
+    fwrite(&byte_rate, 4, 1, f); fwrite(&block, 2, 1, f); fwrite(&bits, 2, 1, f);
+    fwrite("data", 1, 4, f); fwrite(&data_size, 4, 1, f);
+    const std::vector<uint8_t> zeros(data_size);
+    fwrite(zeros.data(), 1, zeros.size(), f);
+    fclose(f);
+    return path;
+}
+
+} // namespace
+
+TEST(Downmix, MatchesScalarAverage) {
+    for (whisper_sample_format format : { WHISPER_SAMPLE_S16, WHISPER_SAMPLE_S24, WHISPER_SAMPLE_S32, WHISPER_SAMPLE_F32 }) {
+        for (int n_channels : { 1, 2, 3, 6, 8, WHISPER_MAX_CHANNELS }) {
+            expect_downmix(format, n_channels, 3001);
+        }
+    }
+}
+
+TEST(Downmix, FramesWiderThanTheStackBuffer) {
+    for (whisper_sample_format format : { WHISPER_SAMPLE_S16, WHISPER_SAMPLE_S24, WHISPER_SAMPLE_S32 }) {
+        expect_downmix(format, 2048, 5);
+        expect_downmix(format, 3000, 5);
+    }
+}
+
+TEST(Downmix, WavMapRejectsTooManyChannels) {
+    whisper_wav_map wav;
+    const std::string ok = write_wav(WHISPER_MAX_CHANNELS, 100);
+    EXPECT_TRUE(whisper_wav_map_open(ok, wav));
+    EXPECT_EQ(wav.n_channels, WHISPER_MAX_CHANNELS);
+    EXPECT_EQ(wav.n_frames, 100);
+
+    whisper_wav_map too_wide;
+    const std::string bad = write_wav(WHISPER_MAX_CHANNELS + 1, 100);
+    EXPECT_FALSE(whisper_wav_map_open(bad, too_wide));
+
+    remove(ok.c_str());
+    remove(bad.c_str());
+}
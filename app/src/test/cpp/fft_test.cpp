@@ -0,0 +1,97 @@
+// planned mixed-radix real FFT (whisper_fft_plan_init / whisper_fft_forward) against
+// a naive double precision DFT, for Whisper's n = 400 and for odd, prime and small sizes
+
+#include "host_stubs.h"
+#include "whisper.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace {
+
+// largest error of the n/2 + 1 output bins, relative to the largest bin magnitude
+// fft(in, out) is the transform under test
+template <typename Fft>
+double max_rel_err(int n, int seed, Fft fft) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> in(n);
+    for (auto & x : in) {
+        x = uniform(rng);
+    }
+
+    std::vector<float> out(2*(n/2 + 1), NAN);
+    fft(in.data(), out.data());
+
+    double max_err = 0.0;
+    double max_abs = 1e-30;
+    for (int k = 0; k <= n/2; k++) {
+        double re = 0.0;
+        double im = 0.0;
+        for (int i = 0; i < n; i++) {
+            const double phase = -2.0*M_PI*(double) ((int64_t) k*i % n)/n;
+            re += in[i]*cos(phase);
+            im += in[i]*sin(phase);
+        }
+        max_err = std::max(max_err, hypot(out[2*k] - re, out[2*k + 1] - im));
+        max_abs = std::max(max_abs, hypot(re, im));
+    }
+    return max_err/max_abs;
+}
+
+void expect_matches_dft(std::initializer_list<int> sizes) {
+    for (int n : sizes) {
+        whisper_fft_plan plan;
+        ASSERT_TRUE(whisper_fft_plan_init(plan, n));
+        std::vector<float> scratch(plan.n_scratch());
+        for (int seed = 0; seed < 3; seed++) {
+            const double err = max_rel_err(n, seed, [&](const float * in, float * out) {
+                whisper_fft_forward(plan, in, out, scratch.data());
+            });
+            EXPECT_LT(err, 1e-5) << "n = " << n << ", seed " << seed;
+        }
+    }
+}
+
+} // namespace
+
+TEST(Fft, WhisperFrameSize) {
+    expect_matches_dft({ WHISPER_N_FFT });
+}
+
+TEST(Fft, SmallSizes) {
+    expect_matches_dft({ 1, 2, 3, 4, 5, 6, 8, 10, 12, 16 });
+}
+
+TEST(Fft, OddSizes) {
+    expect_matches_dft({ 9, 15, 21, 25, 45, 75, 125, 243, 375 });
+}
+
+// primes above 5 go through the generic butterfly, alone or after a radix 2 packing
+TEST(Fft, PrimeSizes) {
+    expect_matches_dft({ 7, 11, 13, 17, 31, 97, 101, 257, 14, 22, 26, 194, 514 });
+}
+
+TEST(Fft, PowersOfTwoAndMixed) {
+    expect_matches_dft({ 32, 64, 512, 1024, 200, 360, 480, 800, 1000 });
+}
+
+// every backend available on the host (avtx needs the Android FFmpeg build) through
+// whisper_fft_backend_create, as log_mel_spectrogram and whisper_mel_stream use them
+TEST(Fft, Backends) {
+    for (int type = 0; type < WHISPER_FFT_COUNT; type++) {
+        for (int n : { WHISPER_N_FFT, 15, 97, 512 }) {
+            auto fft = whisper_fft_backend_create((whisper_fft_backend_type) type, n);
+            if (!fft) {
+                EXPECT_EQ(type, WHISPER_FFT_AVTX) << whisper_fft_backend_names[type];
+                continue;
+            }
+            EXPECT_EQ(fft->type(), type);
+            const double err = max_rel_err(n, 1, [&](const float * in, float * out) {
+                fft->forward(in, out);
+            });
+            EXPECT_LT(err, 1e-5) << whisper_fft_backend_names[type] << ", n = " << n;
+        }
+    }
+}
@@ -0,0 +1,20 @@
+// The prebuilt FFmpeg libraries only exist for the Android ABIs: on the host the
+// libavutil FFT used by the "avtx" backend reports itself unavailable, the
+// builtin and Eigen backends are tested instead (see host_stubs.h for TF Lite)
+
+extern "C" {
+#include <libavutil/error.h>
+#include <libavutil/tx.h>
+}
+
+#include <cerrno>
+
+int av_tx_init(AVTXContext ** ctx, av_tx_fn * tx, enum AVTXType, int, int, const void *, uint64_t) {
+    *ctx = nullptr;
+    *tx  = nullptr;
+    return AVERROR(ENOSYS);
+}
+
+void av_tx_uninit(AVTXContext ** ctx) {
+    *ctx = nullptr;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// whisper.h keeps the TF Lite model and interpreter in its globals but the front
+// end never touches them, and the TF Lite headers are not part of the tree:
+// empty stand-ins are enough to include it on the host
+
+#include <memory>
+
+namespace tflite {
+class FlatBufferModel {};
+class Interpreter {};
+namespace ops {
+namespace builtin {
+class BuiltinOpResolver {};
+} // namespace builtin
+} // namespace ops
+} // namespace tflite
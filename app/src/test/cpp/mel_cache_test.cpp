@@ -0,0 +1,241 @@
+// on-disk spectrogram cache (whisper_mel_cache_*): key, store/load round trip through
+// a temporary directory, rejection of foreign or damaged entries, trim of old entries
+
+#include "test_filters.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+std::vector<float> test_pcm(int n, unsigned seed = 5) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> pcm(n);
+    for (int i = 0; i < n; i++) {
+        pcm[i] = 0.3f*sinf(2.0f*(float) M_PI*330.0f*i/WHISPER_SAMPLE_RATE) + 0.1f*uniform(rng);
+    }
+    return pcm;
+}
+
+std::vector<std::string> list_dir(const std::string & dir) {
+    std::vector<std::string> names;
+    DIR * d = opendir(dir.c_str());
+    while (d) {
+        const struct dirent * e = readdir(d);
+        if (!e) {
+            closedir(d);
+            break;
+        }
+        const std::string name = e->d_name;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+std::vector<char> read_file(const std::string & path) {
+    std::vector<char> buf;
+    FILE * f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return buf;
+    }
+    char tmp[4096];
+    size_t n;
+    while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0) {
+        buf.insert(buf.end(), tmp, tmp + n);
+    }
+    fclose(f);
+    return buf;
+}
+
+void write_file(const std::string & path, const std::vector<char> & buf) {
+    FILE * f = fopen(path.c_str(), "wb");
+    ASSERT_NE(f, nullptr) << path;
+    ASSERT_EQ(fwrite(buf.data(), 1, buf.size(), f), buf.size());
+    fclose(f);
+}
+
+class MelCache : public testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(whisper_test_load_filters(m_filters));
+        whisper_filters_build_bands(m_filters);
+
+        char dir[] = "/tmp/mel_cache_test.XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        m_dir = dir;
+
+        m_pcm = test_pcm(WHISPER_SAMPLE_RATE + 321);
+        whisper_thread_pool pool(2);
+        ASSERT_TRUE(log_mel_spectrogram(whisper_pcm_f32(m_pcm.data(), (int) m_pcm.size()), WHISPER_SAMPLE_RATE,
+                                        WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters.n_mel, pool, m_filters, m_mel));
+        m_key  = whisper_mel_cache_key(whisper_pcm_f32(m_pcm.data(), (int) m_pcm.size()), WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters);
+        m_path = whisper_mel_cache_path(m_dir, m_key);
+    }
+
+    void TearDown() override {
+        for (const std::string & name : list_dir(m_dir)) {
+            unlink((m_dir + "/" + name).c_str());
+        }
+        rmdir(m_dir.c_str());
+    }
+
+    whisper_filters m_filters;
+    std::string m_dir;
+    std::vector<float> m_pcm;
+    whisper_mel m_mel;
+    uint64_t m_key = 0;
+    std::string m_path;
+};
+
+TEST_F(MelCache, KeyFollowsPcmAndFrontEnd) {
+    const whisper_pcm pcm = whisper_pcm_f32(m_pcm.data(), (int) m_pcm.size());
+    EXPECT_EQ(whisper_mel_cache_key(pcm, WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters), m_key);
+    EXPECT_NE(whisper_mel_cache_key(pcm, WHISPER_N_FFT, WHISPER_HOP_LENGTH + 1, m_filters), m_key);
+
+    std::vector<float> other = m_pcm;
+    other[other.size()/2] += 1e-3f;
+    EXPECT_NE(whisper_mel_cache_key(whisper_pcm_f32(other.data(), (int) other.size()), WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters), m_key);
+
+    whisper_filters scaled = m_filters;
+    scaled.data[0] += 1.0f;
+    EXPECT_NE(whisper_mel_cache_key(pcm, WHISPER_N_FFT, WHISPER_HOP_LENGTH, scaled), m_key);
+}
+
+// the loaded entry is mapped in place and holds the same frames and maximum
+TEST_F(MelCache, StoreThenLoad) {
+    ASSERT_TRUE(whisper_mel_cache_store(m_path, m_key, m_mel));
+    // the temporary file was renamed into place
+    EXPECT_EQ(list_dir(m_dir), std::vector<std::string>{ m_path.substr(m_dir.size() + 1) });
+
+    whisper_mel loaded;
+    loaded.data.assign(10, 1.0f);
+    ASSERT_TRUE(whisper_mel_cache_load(m_path, m_key, loaded));
+    EXPECT_TRUE(loaded.mapped);
+    EXPECT_TRUE(loaded.data.empty());
+    ASSERT_EQ(loaded.n_mel, m_mel.n_mel);
+    ASSERT_EQ(loaded.n_len, m_mel.n_len);
+    EXPECT_EQ(loaded.mmax, m_mel.mmax);
+    EXPECT_EQ(memcmp(loaded.frames(), m_mel.data.data(), m_mel.data.size()*sizeof(float)), 0);
+
+    // windows read from the mapped frames match the computed ones
+    const int n_len = std::min(m_mel.n_len, 50);
+    std::vector<float> a((size_t) n_len*m_mel.n_mel);
+    std::vector<float> b(a.size());
+    whisper_mel_get_window(loaded, 10, n_len, a.data());
+    whisper_mel_get_window(m_mel, 10, n_len, b.data());
+    EXPECT_EQ(a, b);
+}
+
+// a second store replaces the entry, and a failed one leaves nothing behind
+TEST_F(MelCache, StoreReplacesAndCleansUp) {
+    ASSERT_TRUE(whisper_mel_cache_store(m_path, m_key, m_mel));
+
+    whisper_mel shorter = m_mel;
+    shorter.n_len = 3;
+    shorter.data.resize((size_t) shorter.n_len*shorter.n_mel);
+    ASSERT_TRUE(whisper_mel_cache_store(m_path, m_key, shorter));
+    EXPECT_EQ(list_dir(m_dir).size(), 1u);
+
+    whisper_mel loaded;
+    ASSERT_TRUE(whisper_mel_cache_load(m_path, m_key, loaded));
+    EXPECT_EQ(loaded.n_len, 3);
+
+    EXPECT_FALSE(whisper_mel_cache_store(m_dir + "/missing/" + "mel.bin", m_key, m_mel));
+    EXPECT_EQ(list_dir(m_dir).size(), 1u);
+}
+
+TEST_F(MelCache, RejectsForeignEntries) {
+    whisper_mel loaded;
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)); // no file
+
+    ASSERT_TRUE(whisper_mel_cache_store(m_path, m_key, m_mel));
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key + 1, loaded));
+
+    const std::vector<char> good = read_file(m_path);
+    ASSERT_EQ(good.size(), sizeof(whisper_mel_cache_header) + m_mel.data.size()*sizeof(float));
+
+    std::vector<char> bad = good;
+    ((whisper_mel_cache_header *) bad.data())->magic ^= 1;
+    write_file(m_path, bad);
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "magic";
+
+    bad = good;
+    ((whisper_mel_cache_header *) bad.data())->version = WHISPER_MEL_CACHE_VERSION + 1;
+    write_file(m_path, bad);
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "version";
+
+    write_file(m_path, good);
+    EXPECT_TRUE(whisper_mel_cache_load(m_path, m_key, loaded));
+}
+
+TEST_F(MelCache, RejectsTruncatedAndCorruptFiles) {
+    ASSERT_TRUE(whisper_mel_cache_store(m_path, m_key, m_mel));
+    const std::vector<char> good = read_file(m_path);
+    whisper_mel loaded;
+
+    write_file(m_path, std::vector<char>(good.begin(), good.end() - 4));
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "truncated frames";
+
+    write_file(m_path, std::vector<char>(good.begin(), good.begin() + sizeof(whisper_mel_cache_header) - 1));
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "truncated header";
+
+    write_file(m_path, std::vector<char>());
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "empty";
+
+    std::vector<char> bad = good;
+    bad.push_back(0);
+    write_file(m_path, bad);
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "trailing bytes";
+
+    bad = good;
+    ((whisper_mel_cache_header *) bad.data())->n_mel = 0;
+    write_file(m_path, bad);
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "n_mel";
+
+    bad = good;
+    ((whisper_mel_cache_header *) bad.data())->n_len = -1;
+    write_file(m_path, bad);
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "n_len";
+
+    bad = good;
+    ((whisper_mel_cache_header *) bad.data())->n_len += 1;
+    write_file(m_path, bad);
+    EXPECT_FALSE(whisper_mel_cache_load(m_path, m_key, loaded)) << "n_len past the end of the file";
+}
+
+// trim keeps the most recently written entries and leaves other files alone
+TEST_F(MelCache, TrimKeepsTheNewestEntries) {
+    const int n_entries = WHISPER_MEL_CACHE_MAX_ENTRIES + 3;
+    std::vector<std::string> paths;
+    for (int i = 0; i < n_entries; i++) {
+        paths.push_back(whisper_mel_cache_path(m_dir, 1000 + i));
+        ASSERT_TRUE(whisper_mel_cache_store(paths.back(), 1000 + i, m_mel));
+
+        // mtimes are compared to the second, spread them out
+        struct timeval times[2] = { { 1000000 + 10*i, 0 }, { 1000000 + 10*i, 0 } };
+        ASSERT_EQ(utimes(paths.back().c_str(), times), 0);
+    }
+    write_file(m_dir + "/notes.txt", std::vector<char>(4, 'x'));
+    write_file(paths[0] + ".tmp", std::vector<char>(4, 'x'));
+
+    whisper_mel_cache_trim(m_dir, WHISPER_MEL_CACHE_MAX_ENTRIES);
+
+    for (int i = 0; i < n_entries; i++) {
+        EXPECT_EQ(access(paths[i].c_str(), F_OK) == 0, i >= n_entries - WHISPER_MEL_CACHE_MAX_ENTRIES) << "entry " << i;
+    }
+    EXPECT_EQ(access((m_dir + "/notes.txt").c_str(), F_OK), 0);
+    EXPECT_EQ(access((paths[0] + ".tmp").c_str(), F_OK), 0);
+    EXPECT_EQ(list_dir(m_dir).size(), (size_t) WHISPER_MEL_CACHE_MAX_ENTRIES + 2);
+
+    // under the limit, nothing goes
+    whisper_mel_cache_trim(m_dir, WHISPER_MEL_CACHE_MAX_ENTRIES);
+    EXPECT_EQ(list_dir(m_dir).size(), (size_t) WHISPER_MEL_CACHE_MAX_ENTRIES + 2);
+}
+
+} // namespace
@@ -0,0 +1,159 @@
+// banded float32 mel projection (whisper_filters_build_bands / whisper_filters_apply)
+// against the dense double precision product with the full filterbank
+
+#include "test_filters.h"
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <random>
+
+namespace {
+
+const double k_max_rel_err = 1e-5;
+
+// Slaney-style triangular filters as in librosa.filters.mel, for shapes the model file does not have
+whisper_filters slaney_filters(int n_mel, int n_fft_bins, int sample_rate) {
+    auto hz_to_mel = [](double hz) {
+        return hz < 1000.0 ? hz/(200.0/3.0) : 15.0 + log(hz/1000.0)/(log(6.4)/27.0);
+    };
+    auto mel_to_hz = [](double mel) {
+        return mel < 15.0 ? mel*(200.0/3.0) : 1000.0*exp((mel - 15.0)*(log(6.4)/27.0));
+    };
+
+    whisper_filters filters;
+    filters.n_mel = n_mel;
+    filters.n_fft = n_fft_bins;
+    filters.data.assign((size_t) n_mel*n_fft_bins, 0.0f);
+
+    const double mel_max = hz_to_mel(sample_rate/2.0);
+    std::vector<double> edges(n_mel + 2);
+    for (int i = 0; i < n_mel + 2; i++) {
+        edges[i] = mel_to_hz(mel_max*i/(n_mel + 1));
+    }
+    for (int j = 0; j < n_mel; j++) {
+        const double norm = 2.0/(edges[j + 2] - edges[j]);
+        for (int k = 0; k < n_fft_bins; k++) {
+            const double hz = (double) k*sample_rate/(2*(n_fft_bins - 1));
+            const double lo = (hz - edges[j])/(edges[j + 1] - edges[j]);
+            const double hi = (edges[j + 2] - hz)/(edges[j + 2] - edges[j + 1]);
+            filters.data[(size_t) j*n_fft_bins + k] = (float) (std::max(0.0, std::min(lo, hi))*norm);
+        }
+    }
+    return filters;
+}
+
+double dense_filter(const whisper_filters & filters, const std::vector<float> & power, int j) {
+    double sum = 0.0;
+    for (int k = 0; k < filters.n_fft; k++) {
+        sum += (double) power[k]*filters.data[(size_t) j*filters.n_fft + k];
+    }
+    return sum;
+}
+
+template <int N_MEL = 0>
+double max_rel_err(const whisper_filters & filters, const std::vector<std::vector<float>> & spectra) {
+    std::vector<float> out(filters.n_mel);
+    double max_err = 0.0;
+    for (const auto & power : spectra) {
+        whisper_filters_apply<N_MEL>(filters, power.data(), out.data());
+        for (int j = 0; j < filters.n_mel; j++) {
+            const double ref = dense_filter(filters, power, j);
+            max_err = std::max(max_err, fabs(out[j] - ref)/std::max(fabs(ref), 1e-30));
+        }
+    }
+    return max_err;
+}
+
+// uniform noise, a steep spectral tilt (speech-like, 100 dB of range) and isolated peaks
+std::vector<std::vector<float>> test_spectra(int n_fft) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    std::vector<std::vector<float>> spectra;
+    for (int t = 0; t < 8; t++) {
+        std::vector<float> power(n_fft);
+        for (auto & p : power) {
+            p = 100.0f*uniform(rng);
+        }
+        spectra.push_back(power);
+    }
+    std::vector<float> tilt(n_fft);
+    for (int k = 0; k < n_fft; k++) {
+        tilt[k] = powf(10.0f, -10.0f*k/n_fft)*(1.0f + uniform(rng));
+    }
+    spectra.push_back(tilt);
+    for (int peak = 1; peak < n_fft; peak += n_fft/7) {
+        std::vector<float> power(n_fft, 1e-6f);
+        power[peak] = 1e3f;
+        spectra.push_back(power);
+    }
+    return spectra;
+}
+
+void expect_bands_cover_filters(const whisper_filters & filters) {
+    ASSERT_EQ((int) filters.band_start.size(), filters.n_mel);
+    for (int j = 0; j < filters.n_mel; j++) {
+        const int k0 = filters.band_start[j];
+        const int len = filters.band_len[j];
+        EXPECT_GE(k0, 0);
+        EXPECT_LE(k0 + len, filters.n_fft);
+        if (len < filters.n_fft) {
+            EXPECT_EQ(len % 4, 0) << "filter " << j;
+        }
+        for (int k = 0; k < filters.n_fft; k++) {
+            if (filters.data[(size_t) j*filters.n_fft + k] != 0.0f) {
+                EXPECT_TRUE(k >= k0 && k < k0 + len) << "filter " << j << " weight " << k << " outside its band";
+            }
+        }
+    }
+}
+
+TEST(MelFilters, ModelFilterbankBandsCoverEveryWeight) {
+    whisper_filters filters;
+    ASSERT_TRUE(whisper_test_load_filters(filters));
+    whisper_filters_build_bands(filters);
+    expect_bands_cover_filters(filters);
+}
+
+TEST(MelFilters, ModelFilterbankBandedMatchesDense) {
+    whisper_filters filters;
+    ASSERT_TRUE(whisper_test_load_filters(filters));
+    ASSERT_EQ(filters.n_mel, WHISPER_N_MEL);
+    ASSERT_EQ(filters.n_fft, 1 + WHISPER_N_FFT/2);
+    whisper_filters_build_bands(filters);
+
+    const auto spectra = test_spectra(filters.n_fft);
+    EXPECT_LT(max_rel_err(filters, spectra), k_max_rel_err);
+    EXPECT_LT(max_rel_err<WHISPER_N_MEL>(filters, spectra), k_max_rel_err);
+}
+
+TEST(MelFilters, Mel128BandedMatchesDense) {
+    whisper_filters filters = slaney_filters(128, 1 + WHISPER_N_FFT/2, WHISPER_SAMPLE_RATE);
+    whisper_filters_build_bands(filters);
+    expect_bands_cover_filters(filters);
+
+    const auto spectra = test_spectra(filters.n_fft);
+    EXPECT_LT(max_rel_err(filters, spectra), k_max_rel_err);
+    EXPECT_LT(max_rel_err<128>(filters, spectra), k_max_rel_err);
+}
+
+// a band that would run past the last bin is grown to the left instead
+TEST(MelFilters, BandAtTheLastBinStaysInRange) {
+    whisper_filters filters;
+    filters.n_mel = 1;
+    filters.n_fft = 10;
+    filters.data.assign(10, 0.0f);
+    filters.data[8] = 0.5f;
+    filters.data[9] = 1.0f;
+    whisper_filters_build_bands(filters);
+    expect_bands_cover_filters(filters);
+
+    std::vector<float> power(10);
+    std::iota(power.begin(), power.end(), 1.0f);
+    float out = 0.0f;
+    whisper_filters_apply(filters, power.data(), &out);
+    EXPECT_FLOAT_EQ(out, 0.5f*9 + 1.0f*10);
+}
+
+} // namespace
@@ -0,0 +1,124 @@
+// block GEMM spectrogram (whisper_dft_get_basis / whisper_mel_frames_gemm) against the
+// per-frame FFT path, through log_mel_spectrogram with either whisper_mel_method
+
+#include "test_filters.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+// same bound as mel_filters_test, see max_rel_err()
+const double k_max_rel_err = 1e-5;
+
+// white noise under a few tones, not a whole number of frames long
+std::vector<float> test_pcm(int n) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> pcm(n);
+    for (int i = 0; i < n; i++) {
+        const double t = (double) i/WHISPER_SAMPLE_RATE;
+        pcm[i] = (float) (0.3*sin(2.0*M_PI*220.0*t) + 0.2*sin(2.0*M_PI*1234.5*t) + 0.1*sin(2.0*M_PI*6000.0*t)) + 0.05f*uniform(rng);
+    }
+    return pcm;
+}
+
+// largest difference of two log10 spectrograms, as energies relative to the largest
+// mel energy of the frame: both paths sum float products of the whole frame, so a band
+// 40 dB under the frame's peak only keeps float precision relative to that peak
+double max_rel_err(const whisper_mel & a, const whisper_mel & b) {
+    double max_err = 0.0;
+    for (int i = 0; i < a.n_len; i++) {
+        const float * fa = a.data.data() + (size_t) i*a.n_mel;
+        const float * fb = b.data.data() + (size_t) i*b.n_mel;
+        const double peak = pow(10.0, (double) *std::max_element(fb, fb + b.n_mel));
+        for (int j = 0; j < a.n_mel; j++) {
+            max_err = std::max(max_err, fabs(pow(10.0, (double) fa[j]) - pow(10.0, (double) fb[j]))/peak);
+        }
+    }
+    return max_err;
+}
+
+class MelGemm : public testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(whisper_test_load_filters(m_filters));
+        whisper_filters_build_bands(m_filters);
+    }
+
+    whisper_mel spectrogram(const std::vector<float> & pcm, whisper_mel_method method, int n_threads = 2) {
+        whisper_thread_pool pool(n_threads);
+        whisper_mel mel;
+        EXPECT_TRUE(log_mel_spectrogram(whisper_pcm_f32(pcm.data(), (int) pcm.size()), WHISPER_SAMPLE_RATE,
+                                        WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters.n_mel, pool, m_filters, mel, method));
+        return mel;
+    }
+
+    whisper_filters m_filters;
+};
+
+// the basis holds the Hann window, the DFT and the factor 2 of the folded bins:
+// one frame through it gives the FFT power spectrum
+TEST_F(MelGemm, BasisMatchesFftPowerSpectrum) {
+    const whisper_dft_basis & basis = whisper_dft_get_basis(WHISPER_N_FFT);
+    ASSERT_EQ(basis.n_fft, 1 + WHISPER_N_FFT/2);
+    ASSERT_EQ((int) basis.w.rows(), WHISPER_N_FFT);
+    ASSERT_EQ((int) basis.w.cols(), 2*basis.n_fft);
+
+    const std::vector<float> pcm = test_pcm(WHISPER_N_FFT);
+    std::vector<float> windowed(WHISPER_N_FFT);
+    for (int t = 0; t < WHISPER_N_FFT; t++) {
+        windowed[t] = (float) (0.5*(1.0 - cos((2.0*M_PI*t)/WHISPER_N_FFT)))*pcm[t];
+    }
+    auto fft = whisper_fft_backend_create(WHISPER_FFT_BUILTIN, WHISPER_N_FFT);
+    std::vector<float> spec(2*basis.n_fft);
+    fft->forward(windowed.data(), spec.data());
+
+    double max_power = 0.0;
+    std::vector<double> power(basis.n_fft);
+    for (int k = 0; k < basis.n_fft; k++) {
+        power[k] = (double) spec[2*k]*spec[2*k] + (double) spec[2*k + 1]*spec[2*k + 1];
+        if (k > 0 && k < WHISPER_N_FFT/2) {
+            power[k] *= 2.0;
+        }
+        max_power = std::max(max_power, power[k]);
+    }
+    for (int k = 0; k < basis.n_fft; k++) {
+        double re = 0.0;
+        double im = 0.0;
+        for (int t = 0; t < WHISPER_N_FFT; t++) {
+            re += (double) pcm[t]*basis.w(t, k);
+            im += (double) pcm[t]*basis.w(t, basis.n_fft + k);
+        }
+        EXPECT_NEAR(re*re + im*im, power[k], k_max_rel_err*max_power) << "bin " << k;
+    }
+}
+
+TEST_F(MelGemm, MatchesFftSpectrogram) {
+    const std::vector<float> pcm = test_pcm(5*WHISPER_SAMPLE_RATE + 77);
+    const whisper_mel ref  = spectrogram(pcm, WHISPER_MEL_FFT);
+    const whisper_mel gemm = spectrogram(pcm, WHISPER_MEL_GEMM);
+
+    ASSERT_EQ(gemm.n_len, ref.n_len);
+    ASSERT_EQ(gemm.n_mel, ref.n_mel);
+    ASSERT_EQ(gemm.data.size(), ref.data.size());
+    EXPECT_LT(max_rel_err(gemm, ref), k_max_rel_err);
+    EXPECT_NEAR(gemm.mmax, ref.mmax, 1e-5);
+}
+
+// blocks are cut per thread, the last frames run past the end of the input
+TEST_F(MelGemm, BlockAndTailBoundaries) {
+    for (int n : { WHISPER_N_FFT, WHISPER_N_FFT + 1, 20*WHISPER_HOP_LENGTH - 1, 33*WHISPER_HOP_LENGTH + 5, WHISPER_SAMPLE_RATE }) {
+        const std::vector<float> pcm = test_pcm(n);
+        for (int n_threads : { 1, 3 }) {
+            const whisper_mel ref  = spectrogram(pcm, WHISPER_MEL_FFT, n_threads);
+            const whisper_mel gemm = spectrogram(pcm, WHISPER_MEL_GEMM, n_threads);
+            ASSERT_EQ(gemm.n_len, ref.n_len) << n << " samples";
+            EXPECT_LT(max_rel_err(gemm, ref), k_max_rel_err) << n << " samples, " << n_threads << " threads";
+        }
+    }
+}
+
+} // namespace
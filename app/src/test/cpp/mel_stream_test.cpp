@@ -0,0 +1,197 @@
+// incremental spectrogram (whisper_mel_stream) fed in uneven chunks, against the
+// whole-file log_mel_spectrogram and against the running-max clamping it documents
+
+#include "test_filters.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace {
+
+const int k_rate = WHISPER_SAMPLE_RATE;
+
+// a 440 Hz tone over white noise, louder in the first second: the noise keeps every mel
+// band well within 80 dB of the maximum, so the whole-file clamp at max - 8 never applies
+std::vector<float> test_pcm(int n) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> pcm(n);
+    for (int i = 0; i < n; i++) {
+        const float gain = i < k_rate ? 0.5f : 0.05f;
+        pcm[i] = gain*sinf(2.0f*(float) M_PI*440.0f*i/k_rate) + 0.1f*uniform(rng);
+    }
+    return pcm;
+}
+
+// pushes pcm in chunks of 1, 7, 159, 160, 161, 399, 400, 401, 1000 and 4321 samples, then flushes
+std::vector<float> stream_mel(whisper_mel_stream & stream, const std::vector<float> & pcm, int64_t * n_frames_before_flush = nullptr) {
+    static const int sizes[] = { 1, 7, 159, 160, 161, 399, 400, 401, 1000, 4321 };
+    std::vector<float> out;
+    size_t i = 0;
+    for (int k = 0; i < pcm.size(); k++) {
+        const int n = (int) std::min<size_t>(sizes[k%10], pcm.size() - i);
+        const size_t n_before = out.size();
+        const int n_out = stream.push(pcm.data() + i, n, out);
+        EXPECT_EQ((size_t) n_out*stream.n_mel(), out.size() - n_before);
+        i += n;
+    }
+    if (n_frames_before_flush) {
+        *n_frames_before_flush = stream.n_frames();
+    }
+    const size_t n_before = out.size();
+    const int n_out = stream.flush(out);
+    EXPECT_EQ((size_t) n_out*stream.n_mel(), out.size() - n_before);
+    return out;
+}
+
+class MelStream : public testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(whisper_test_load_filters(m_filters));
+        whisper_filters_build_bands(m_filters);
+    }
+
+    whisper_filters m_filters;
+};
+
+TEST_F(MelStream, MatchesWholeFileSpectrogram) {
+    const std::vector<float> pcm = test_pcm(3*k_rate + 123);
+
+    whisper_thread_pool pool(2);
+    whisper_mel ref;
+    ASSERT_TRUE(log_mel_spectrogram(whisper_pcm_f32(pcm.data(), (int) pcm.size()), WHISPER_SAMPLE_RATE,
+                                    WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters.n_mel, pool, m_filters, ref));
+
+    // the whole file fits in the running max, which then ends up at the file maximum
+    whisper_mel_stream stream(m_filters, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ref.n_len);
+    const std::vector<float> out = stream_mel(stream, pcm);
+
+    ASSERT_EQ(stream.n_frames(), ref.n_len);
+    ASSERT_EQ(out.size(), (size_t) ref.n_len*ref.n_mel);
+
+    // clamped and normalized by the window read, [n_mel][n_len]
+    std::vector<float> window((size_t) ref.n_len*ref.n_mel);
+    whisper_mel_get_window(ref, 0, ref.n_len, window.data());
+    for (int i = 0; i < ref.n_len; i++) {
+        for (int j = 0; j < ref.n_mel; j++) {
+            ASSERT_NEAR(out[(size_t) i*ref.n_mel + j], window[(size_t) j*ref.n_len + i], 1e-5f) << "frame " << i << ", mel " << j;
+        }
+    }
+}
+
+// frame i is clamped at 8 below the largest value of frames (i - max_len, i]
+TEST_F(MelStream, ClampsAgainstTheRunningMax) {
+    std::vector<float> pcm = test_pcm(4*k_rate);
+    for (int i = 2*k_rate; i < 3*k_rate; i++) {
+        pcm[i] = 0.0f; // a second of digital silence, at the log10 floor of -10
+    }
+    const int max_len = 50;
+
+    whisper_mel_stream stream(m_filters, WHISPER_N_FFT, WHISPER_HOP_LENGTH, max_len);
+    const std::vector<float> out = stream_mel(stream, pcm);
+
+    auto fft = whisper_fft_backend_create(WHISPER_FFT_BUILTIN, WHISPER_N_FFT);
+    const int n_mel = m_filters.n_mel;
+    const int n_len = (int) pcm.size()/WHISPER_HOP_LENGTH;
+    ASSERT_EQ(out.size(), (size_t) n_len*n_mel);
+
+    // raw log10 frames, zero padded past the end like log_mel_spectrogram
+    std::vector<float> raw((size_t) n_len*n_mel);
+    std::vector<float> fft_in(WHISPER_N_FFT);
+    std::vector<float> fft_out(2*(1 + WHISPER_N_FFT/2));
+    for (int i = 0; i < n_len; i++) {
+        for (int j = 0; j < WHISPER_N_FFT; j++) {
+            const size_t t = (size_t) i*WHISPER_HOP_LENGTH + j;
+            const float hann = 0.5*(1.0 - cos((2.0*M_PI*j)/WHISPER_N_FFT));
+            fft_in[j] = t < pcm.size() ? hann*pcm[t] : 0.0f;
+        }
+        whisper_mel_frame(*fft, m_filters, WHISPER_N_FFT, fft_in.data(), fft_out.data(), raw.data() + (size_t) i*n_mel);
+    }
+
+    int n_clamped = 0;
+    for (int i = 0; i < n_len; i++) {
+        float mmax = -1e20f;
+        for (int k = std::max(0, i - max_len + 1); k <= i; k++) {
+            for (int j = 0; j < n_mel; j++) {
+                mmax = std::max(mmax, raw[(size_t) k*n_mel + j]);
+            }
+        }
+        for (int j = 0; j < n_mel; j++) {
+            const float v = raw[(size_t) i*n_mel + j];
+            n_clamped += v < mmax - 8.0f;
+            const float expected = (std::max(v, mmax - 8.0f) + 4.0f)/4.0f;
+            ASSERT_NEAR(out[(size_t) i*n_mel + j], expected, 1e-5f) << "frame " << i << ", mel " << j;
+        }
+    }
+    // the silent second is clamped while the frames before it are in the running max
+    EXPECT_GT(n_clamped, max_len*n_mel/2);
+}
+
+// push() emits a frame once its last sample arrives, flush() the ones that run past the
+// end of input: n_samples/fft_step frames in all, as log_mel_spectrogram
+TEST_F(MelStream, FrameCountAtTheEndOfInput) {
+    for (int n : { 0, 1, 159, 160, 161, 399, 400, 401, 560, 16000, 16001 }) {
+        const std::vector<float> pcm = test_pcm(n);
+        whisper_mel_stream stream(m_filters);
+        int64_t n_pushed = 0;
+        const std::vector<float> out = stream_mel(stream, pcm, &n_pushed);
+
+        const int64_t n_complete = n < WHISPER_N_FFT ? 0 : (n - WHISPER_N_FFT)/WHISPER_HOP_LENGTH + 1;
+        EXPECT_EQ(n_pushed, std::min<int64_t>(n_complete, n/WHISPER_HOP_LENGTH)) << n << " samples";
+        EXPECT_EQ(stream.n_frames(), n/WHISPER_HOP_LENGTH) << n << " samples";
+        EXPECT_EQ(out.size(), (size_t) (n/WHISPER_HOP_LENGTH)*m_filters.n_mel) << n << " samples";
+
+        // a second flush has nothing left to emit
+        std::vector<float> more;
+        EXPECT_EQ(stream.flush(more), 0);
+        EXPECT_TRUE(more.empty());
+    }
+}
+
+// pad_value() is what whisper_mel_get_window() writes past the end of the file when the
+// running max is the file maximum, and follows the window of the last max_len frames
+TEST_F(MelStream, PadValueMatchesWindowPadding) {
+    const std::vector<float> pcm = test_pcm(2*k_rate + 77);
+
+    whisper_thread_pool pool(2);
+    whisper_mel ref;
+    ASSERT_TRUE(log_mel_spectrogram(whisper_pcm_f32(pcm.data(), (int) pcm.size()), WHISPER_SAMPLE_RATE,
+                                    WHISPER_N_FFT, WHISPER_HOP_LENGTH, m_filters.n_mel, pool, m_filters, ref));
+
+    whisper_mel_stream stream(m_filters, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ref.n_len);
+    // nothing seen yet: the log10 floor of -10
+    EXPECT_FLOAT_EQ(stream.pad_value(), (-10.0f + 4.0f)/4.0f);
+    stream_mel(stream, pcm);
+
+    const int n_len = 20;
+    std::vector<float> window((size_t) n_len*ref.n_mel);
+    whisper_mel_get_window(ref, ref.n_len - n_len/2, n_len, window.data());
+    for (int j = 0; j < ref.n_mel; j++) {
+        for (int i = n_len/2; i < n_len; i++) {
+            ASSERT_NEAR(window[(size_t) j*n_len + i], stream.pad_value(), 1e-6f) << "frame " << i << ", mel " << j;
+        }
+    }
+
+    // the loud first second drops out of a short running max, the padding follows it down
+    whisper_mel_stream short_max(m_filters, WHISPER_N_FFT, WHISPER_HOP_LENGTH, 50);
+    stream_mel(short_max, pcm);
+    EXPECT_LT(short_max.pad_value(), stream.pad_value());
+
+    stream.reset();
+    EXPECT_FLOAT_EQ(stream.pad_value(), (-10.0f + 4.0f)/4.0f);
+}
+
+// reset() starts a new stream: same frames as a fresh object
+TEST_F(MelStream, ResetStartsOver) {
+    const std::vector<float> pcm = test_pcm(k_rate/2 + 77);
+    whisper_mel_stream stream(m_filters);
+    EXPECT_FALSE(stream_mel(stream, test_pcm(k_rate)).empty());
+    stream.reset();
+    const std::vector<float> again = stream_mel(stream, pcm);
+
+    whisper_mel_stream fresh(m_filters);
+    EXPECT_EQ(again, stream_mel(fresh, pcm));
+}
+
+} // namespace
@@ -0,0 +1,124 @@
+// streaming resampler (whisper_resampler) to 16 kHz: output length, tones in the pass band
+// and the stop band, and the seek point that resumes a continuous run sample for sample
+
+#include "test_filters.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+namespace {
+
+const int k_rates[] = { 8000, 44100, 48000 };
+
+std::vector<float> tone(int rate, double freq, int n, double amp = 0.5) {
+    std::vector<float> x(n);
+    for (int i = 0; i < n; i++) {
+        x[i] = (float) (amp*sin(2.0*M_PI*freq*i/rate));
+    }
+    return x;
+}
+
+// pushes x in chunks of 1, 17, 1000 and 4096 samples, then flushes
+std::vector<float> resample(whisper_resampler & rs, const std::vector<float> & x, bool flush = true) {
+    static const int sizes[] = { 1, 17, 1000, 4096 };
+    std::vector<float> out;
+    size_t i = 0;
+    for (int k = 0; i < x.size(); k++) {
+        const int n = (int) std::min<size_t>(sizes[k%4], x.size() - i);
+        rs.push(x.data() + i, n, out);
+        i += n;
+    }
+    if (flush) {
+        rs.flush(out);
+    }
+    return out;
+}
+
+// n_out() samples once flushed, whatever the chunking, and equal rates pass through
+TEST(Resampler, OutputLength) {
+    for (int rate : { 8000, 11025, 16000, 22050, 44100, 48000 }) {
+        for (int n : { 0, 1, 2, 999, rate, 3*rate + 7 }) {
+            whisper_resampler rs(rate);
+            const std::vector<float> x = tone(rate, 440.0, n);
+            const std::vector<float> out = resample(rs, x);
+            EXPECT_EQ((int64_t) out.size(), rs.n_out(n)) << rate << " Hz, " << n << " samples";
+            EXPECT_EQ((int64_t) out.size(), ((int64_t) n*WHISPER_SAMPLE_RATE + rate - 1)/rate) << rate << " Hz, " << n << " samples";
+
+            whisper_resampler whole(rate);
+            std::vector<float> out_whole;
+            whole.push(x.data(), n, out_whole);
+            whole.flush(out_whole);
+            EXPECT_EQ(out, out_whole) << rate << " Hz, " << n << " samples";
+
+            if (rate == WHISPER_SAMPLE_RATE) {
+                EXPECT_EQ(out, x);
+            }
+        }
+    }
+}
+
+// a 1 kHz tone comes out as the same tone at 16 kHz, in phase: the filter is centred
+TEST(Resampler, PassbandTone) {
+    for (int rate : k_rates) {
+        whisper_resampler rs(rate);
+        const std::vector<float> out = resample(rs, tone(rate, 1000.0, 2*rate));
+        const std::vector<float> ref = tone(WHISPER_SAMPLE_RATE, 1000.0, (int) out.size());
+
+        // away from the zero padded ends
+        double max_err = 0.0;
+        for (size_t i = 1000; i + 1000 < out.size(); i++) {
+            max_err = std::max(max_err, (double) fabs(out[i] - ref[i]));
+        }
+        EXPECT_LT(max_err, 1e-3) << rate << " Hz";
+    }
+}
+
+// above the 8 kHz Nyquist frequency of the output, a tone is filtered out instead of aliasing
+TEST(Resampler, StopbandTone) {
+    for (int rate : { 44100, 48000 }) {
+        whisper_resampler rs(rate);
+        const std::vector<float> out = resample(rs, tone(rate, 10000.0, rate));
+
+        double energy = 0.0;
+        int n = 0;
+        for (size_t i = 1000; i + 1000 < out.size(); i++, n++) {
+            energy += (double) out[i]*out[i];
+        }
+        // a 0.5 amplitude tone has a mean square of 0.125, about -80 dB under it
+        EXPECT_LT(energy/n, 0.125*1e-8) << rate << " Hz";
+    }
+}
+
+// after reset() at seek_input(), the output matches the continuous run from the reported position
+// on, once the taps no longer reach before the seek point; the position is never after the target
+TEST(Resampler, SeekPosition) {
+    for (int rate : k_rates) {
+        const std::vector<float> x = tone(rate, 1234.5, 3*rate);
+
+        whisper_resampler rs(rate);
+        const std::vector<float> ref = resample(rs, x);
+        const int l = rs.rate_ratio_l();
+        const int m = rs.rate_ratio_m();
+
+        for (int64_t sample : { (int64_t) 0, (int64_t) 1, (int64_t) l - 1, (int64_t) l, (int64_t) 12345, (int64_t) WHISPER_SAMPLE_RATE + 7 }) {
+            int64_t pos = -1;
+            const int64_t input = rs.seek_input(sample, pos);
+            ASSERT_LE(pos, sample) << rate << " Hz, sample " << sample;
+            ASSERT_LT(sample - pos, l) << rate << " Hz, sample " << sample;
+            ASSERT_EQ(input*l, pos*m) << rate << " Hz, sample " << sample;
+
+            rs.reset();
+            const std::vector<float> out = resample(rs, std::vector<float>(x.begin() + input, x.end()));
+            ASSERT_EQ((int64_t) out.size(), (int64_t) ref.size() - pos) << rate << " Hz, sample " << sample;
+
+            // the taps span about 2*16 zero crossings of the anti-aliasing filter, on either side
+            const int settle = 64*std::max(1, rate/WHISPER_SAMPLE_RATE);
+            for (size_t j = settle; j + settle < out.size(); j++) {
+                ASSERT_NEAR(out[j], ref[pos + j], 1e-6f) << rate << " Hz, sample " << sample << ", output " << j;
+            }
+        }
+    }
+}
+
+} // namespace
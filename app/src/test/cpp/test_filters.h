@@ -0,0 +1,27 @@
+#pragma once
+
+// the model's mel filterbank for the host tests, read from the filters_vocab file
+// of the tree (WHISPER_TEST_FILTERS, set by CMakeLists.txt)
+
+#include "host_stubs.h"
+#include "whisper.h"
+
+#include <cstdio>
+
+// n_mel, n_fft and the filter matrix, without building the bands
+inline bool whisper_test_load_filters(whisper_filters & filters, const char * path = WHISPER_TEST_FILTERS) {
+    FILE * f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint32_t magic = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == 0x5553454e &&
+              fread(&filters.n_mel, sizeof(filters.n_mel), 1, f) == 1 &&
+              fread(&filters.n_fft, sizeof(filters.n_fft), 1, f) == 1;
+    if (ok) {
+        filters.data.resize((size_t) filters.n_mel*filters.n_fft);
+        ok = fread(filters.data.data(), sizeof(float), filters.data.size(), f) == filters.data.size();
+    }
+    fclose(f);
+    return ok;
+}
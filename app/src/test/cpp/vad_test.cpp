@@ -0,0 +1,218 @@
+// behaviour of the energy / zero-crossing VAD (whisper_vad_detect) on synthetic PCM,
+// and of the packing of its speech islands into encoder windows (whisper_vad_pack)
+
+#include "host_stubs.h"
+#include "whisper.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace {
+
+const int k_rate = WHISPER_SAMPLE_RATE;
+
+void scale_to_dbfs(float * x, int n, float rms_db) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += (double) x[i]*x[i];
+    }
+    const double gain = pow(10.0, rms_db/20.0)/sqrt(sum/n + 1e-30);
+    for (int i = 0; i < n; i++) {
+        x[i] = (float) (x[i]*gain);
+    }
+}
+
+// voiced speech stand-in on [t0, t1) seconds: harmonics of a 120 Hz pitch under a
+// 4 Hz syllable envelope that never drops below half, at rms_db dBFS
+void add_speech(std::vector<float> & x, double t0, double t1, float rms_db) {
+    const int i0 = (int) (t0*k_rate);
+    const int i1 = std::min((int) (t1*k_rate), (int) x.size());
+    std::vector<float> s(i1 - i0);
+    for (int i = 0; i < (int) s.size(); i++) {
+        const double t = (double) i/k_rate;
+        const double env = 0.75 + 0.25*sin(2.0*M_PI*4.0*t);
+        double v = 0.0;
+        for (int h = 1; h <= 20; h++) {
+            v += sin(2.0*M_PI*120.0*h*t + h)/h;
+        }
+        s[i] = (float) (env*v);
+    }
+    scale_to_dbfs(s.data(), s.size(), rms_db);
+    for (int i = 0; i < (int) s.size(); i++) {
+        x[i0 + i] += s[i];
+    }
+}
+
+// white noise over the whole buffer at rms_db dBFS
+void add_noise(std::vector<float> & x, float rms_db, uint32_t seed = 1) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> n(x.size());
+    for (auto & v : n) {
+        v = uniform(rng);
+    }
+    scale_to_dbfs(n.data(), n.size(), rms_db);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] += n[i];
+    }
+}
+
+whisper_vad detect(const std::vector<float> & x) {
+    whisper_vad vad;
+    whisper_vad_detect(whisper_pcm_f32(x.data(), x.size()), whisper_vad_params(), g_whisper_pool, vad);
+    return vad;
+}
+
+// share of the VAD frames in [t0, t1) seconds marked as speech
+double speech_ratio(const whisper_vad & vad, double t0, double t1) {
+    const int f0 = (int) (t0*k_rate/vad.frame_len);
+    const int f1 = std::min((int) (t1*k_rate/vad.frame_len), (int) vad.speech.size());
+    int n = 0;
+    for (int f = f0; f < f1; f++) {
+        n += vad.speech[f];
+    }
+    return f1 > f0 ? (double) n/(f1 - f0) : 0.0;
+}
+
+TEST(Vad, SpeechBurstsInQuietRoom) {
+    std::vector<float> x(10*k_rate);
+    add_noise(x, -60.0f);
+    add_speech(x, 2.0, 3.0, -20.0f);
+    add_speech(x, 6.0, 7.5, -20.0f);
+
+    const whisper_vad vad = detect(x);
+    EXPECT_GE(vad.thold, whisper_vad_params().energy_thold);
+    EXPECT_DOUBLE_EQ(speech_ratio(vad, 2.0, 3.0), 1.0);
+    EXPECT_DOUBLE_EQ(speech_ratio(vad, 6.0, 7.5), 1.0);
+    EXPECT_DOUBLE_EQ(speech_ratio(vad, 0.0, 1.5), 0.0);
+    EXPECT_DOUBLE_EQ(speech_ratio(vad, 4.0, 5.5), 0.0);
+    EXPECT_DOUBLE_EQ(speech_ratio(vad, 8.5, 10.0), 0.0);
+}
+
+// a steady hiss well above digital silence is noise, not speech
+TEST(Vad, NoiseFloorIsNotSpeech) {
+    std::vector<float> x(10*k_rate);
+    add_noise(x, -55.0f, 7);
+    add_speech(x, 4.0, 7.0, -25.0f);
+
+    const whisper_vad vad = detect(x);
+    EXPECT_DOUBLE_EQ(speech_ratio(vad, 4.0, 7.0), 1.0);
+    EXPECT_LT(speech_ratio(vad, 0.0, 3.5), 0.02);
+    EXPECT_LT(speech_ratio(vad, 7.5, 10.0), 0.02);
+}
+
+// without any pause the 10th percentile is speech: the threshold must stay near the absolute floor
+TEST(Vad, ContinuousSpeechIsAllSpeech) {
+    std::vector<float> x(20*k_rate);
+    add_noise(x, -60.0f);
+    add_speech(x, 0.0, 20.0, -20.0f);
+
+    const whisper_vad vad = detect(x);
+    const whisper_vad_params params;
+    EXPECT_LE(vad.thold, params.energy_thold + params.noise_cap);
+    EXPECT_GE(speech_ratio(vad, 0.0, 20.0), 0.99);
+}
+
+TEST(Vad, QuietSpeakerNextToLoudOne) {
+    std::vector<float> x(20*k_rate);
+    add_noise(x, -60.0f);
+    add_speech(x, 0.0, 10.0, -12.0f);
+    add_speech(x, 10.0, 20.0, -34.0f);
+
+    const whisper_vad vad = detect(x);
+    EXPECT_GE(speech_ratio(vad, 0.0, 10.0), 0.99);
+    EXPECT_GE(speech_ratio(vad, 10.0, 20.0), 0.95);
+}
+
+TEST(Vad, DigitalSilenceUsesTheAbsoluteFloor) {
+    std::vector<float> x(5*k_rate, 0.0f);
+    const whisper_vad vad = detect(x);
+    EXPECT_FLOAT_EQ(vad.thold, whisper_vad_params().energy_thold);
+    EXPECT_EQ(vad.n_speech(), 0);
+}
+
+whisper_mel mel_for(int n_samples) {
+    whisper_mel mel;
+    mel.n_len = n_samples/WHISPER_HOP_LENGTH;
+    mel.n_mel = WHISPER_N_MEL;
+    return mel;
+}
+
+// every mel frame of a VAD speech frame is in exactly one window, windows are full at most,
+// in file order and inside the spectrogram
+void expect_packing_keeps_speech(const whisper_vad & vad, const whisper_mel & mel, const std::vector<whisper_window> & windows) {
+    const int r = vad.frame_len/WHISPER_HOP_LENGTH;
+    std::vector<int> covered(mel.n_len, 0);
+    int prev_end = 0;
+    for (const auto & win : windows) {
+        EXPECT_LE(win.n_len(), WHISPER_MEL_LEN);
+        for (const auto & seg : win.segments) {
+            EXPECT_GE(seg.offset, prev_end);
+            EXPECT_GT(seg.n_len, 0);
+            EXPECT_LE(seg.offset + seg.n_len, mel.n_len);
+            for (int k = seg.offset; k < std::min(seg.offset + seg.n_len, mel.n_len); k++) {
+                covered[k]++;
+            }
+            prev_end = seg.offset + seg.n_len;
+        }
+    }
+    for (int f = 0; f < (int) vad.speech.size(); f++) {
+        if (!vad.speech[f]) {
+            continue;
+        }
+        for (int k = f*r; k < std::min((f + 1)*r, mel.n_len); k++) {
+            ASSERT_EQ(covered[k], 1) << "mel frame " << k << " of speech frame " << f;
+        }
+    }
+}
+
+TEST(VadPack, WindowsKeepEverySpeechFrameAndTheHangover) {
+    // words with short and long pauses, and a 70 s monologue longer than two windows
+    std::vector<float> x(150*k_rate);
+    add_noise(x, -60.0f);
+    const double words[][2] = { { 1.0, 1.4 }, { 1.6, 2.3 }, { 5.0, 5.2 }, { 20.0, 27.0 }, { 27.5, 31.0 }, { 40.0, 110.0 }, { 149.0, 149.9 } };
+    for (const auto & w : words) {
+        add_speech(x, w[0], w[1], -25.0f);
+    }
+
+    const whisper_vad vad = detect(x);
+    const whisper_vad_params params;
+    const double hangover_s = (double) params.hangover*vad.frame_len/k_rate;
+    const double onset_s    = (double) params.onset*vad.frame_len/k_rate;
+    for (const auto & w : words) {
+        EXPECT_DOUBLE_EQ(speech_ratio(vad, w[0] - onset_s + 0.02, std::min(w[1] + hangover_s - 0.02, 150.0)), 1.0)
+            << "word at " << w[0] << " s";
+    }
+
+    const whisper_mel mel = mel_for(x.size());
+    std::vector<whisper_window> windows;
+    whisper_vad_pack(vad, mel, whisper_pack_params(), windows);
+    expect_packing_keeps_speech(vad, mel, windows);
+    EXPECT_LT((int) windows.size(), whisper_mel_n_windows(mel));
+}
+
+// islands straight from a hand-made decision, one of them longer than a window
+TEST(VadPack, LongIslandsAreCutWithoutLosingFrames) {
+    whisper_vad vad;
+    vad.frame_len = 2*WHISPER_HOP_LENGTH;
+    vad.speech.assign(6000, 0);
+    vad.energy.assign(6000, -60.0f);
+    auto mark = [&](int f0, int f1, float level) {
+        for (int f = f0; f < f1; f++) {
+            vad.speech[f] = 1;
+            vad.energy[f] = level + 3.0f*sinf(0.37f*f);
+        }
+    };
+    mark(10, 60, -20.0f);
+    mark(100, 3700, -20.0f);  // 7200 mel frames
+    mark(3750, 3760, -30.0f);
+    mark(5990, 6000, -20.0f); // up to the last frame
+
+    const whisper_mel mel = mel_for(6000*vad.frame_len);
+    std::vector<whisper_window> windows;
+    whisper_vad_pack(vad, mel, whisper_pack_params(), windows);
+    expect_packing_keeps_speech(vad, mel, windows);
+}
+
+} // namespace